@@ -12,6 +12,7 @@ publicHeaders.files = mabstractdecorator.h mrmi.h mabstractappinterface.h
 dbusiface.files = mdecorator_dbus_interface.h
 HEADERS += $${publicHeaders.files} mrmi.cpp
 SOURCES += mabstractdecorator.cpp mrmi.cpp mabstractappinterface.cpp
+LIBS += -lrt
 PRE_TARGETDEPS += mdecorator_dbus_interface.h
 
 publicHeaders.path = $$M_INSTALL_HEADERS/libdecorator
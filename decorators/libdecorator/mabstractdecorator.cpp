@@ -26,6 +26,7 @@
 #include <QRect>
 #include <QRegion>
 #include <QDesktopWidget>
+#include <QDataStream>
 #include <QApplication>
 
 #include <X11/Xutil.h>
@@ -38,6 +39,9 @@ struct MAbstractDecoratorPrivate
     Qt::HANDLE client;
     MRmiServer* rmi;
     QRect clientGeometry;
+    QString wmName;
+    unsigned angle;
+    bool onlyStatusbar, showDialog;
     MAbstractDecorator* q_ptr;
 };
 
@@ -47,7 +51,11 @@ MAbstractDecorator::MAbstractDecorator(QObject *parent)
 {
     Q_D(MAbstractDecorator);
     
+    d->client = 0;
+    d->angle = 0;
+    d->onlyStatusbar = d->showDialog = false;
     d->rmi = new MRmiServer(".mabstractdecorator", this);
+    d->rmi->setCoalesced("decoratorRectChanged");
     d->rmi->exportObject(this);
 }
 
@@ -73,10 +81,48 @@ void MAbstractDecorator::RemoteSetManagedWinId(unsigned window,
 
     d->client = window;
     d->clientGeometry = geo;
+    d->wmName = wmname;
+    d->angle = angle;
+    d->onlyStatusbar = only_statusbar;
+    d->showDialog = show_dialog;
 
     manageEvent(window, wmname, angle, only_statusbar, show_dialog);
 }
 
+// @fields has the @changed ones in the order of ManagedWinField.
+void MAbstractDecorator::RemoteUpdateManagedWin(unsigned changed,
+                                                const QByteArray &fields)
+{
+    Q_D(MAbstractDecorator);
+    QDataStream in(fields);
+    quint32 window;
+
+    if (changed & WindowField) {
+        in >> window;
+        d->client = window;
+    }
+    if (changed & GeometryField)
+        in >> d->clientGeometry;
+    if (changed & WmNameField)
+        in >> d->wmName;
+    if (changed & OrientationField)
+        in >> d->angle;
+    if (changed & OnlyStatusbarField)
+        in >> d->onlyStatusbar;
+    if (changed & ShowDialogField)
+        in >> d->showDialog;
+    if (in.status() != QDataStream::Ok) {
+        qWarning("MAbstractDecorator::RemoteUpdateManagedWin: bad fields");
+        return;
+    }
+
+    if (changed & ~OnlyStatusbarField)
+        manageEvent(d->client, d->wmName, d->angle,
+                    d->onlyStatusbar, d->showDialog);
+    else if (changed)
+        setOnlyStatusbar(d->onlyStatusbar);
+}
+
 void MAbstractDecorator::setAvailableGeometry(const QRect& rect)
 {
     Q_D(MAbstractDecorator);
@@ -94,6 +140,9 @@ void MAbstractDecorator::queryDialogAnswer(unsigned int w, bool a)
 
 void MAbstractDecorator::RemoteSetOnlyStatusbar(bool mode)
 {
+    Q_D(MAbstractDecorator);
+
+    d->onlyStatusbar = mode;
     setOnlyStatusbar(mode);
 }
 
@@ -39,6 +39,19 @@ public:
     MAbstractDecorator(QObject *parent = 0);
     virtual ~MAbstractDecorator();
 
+    /*!
+     * Fields of the managed window state sent by RemoteUpdateManagedWin().
+     */
+    enum ManagedWinField {
+        WindowField          = 1 << 0,
+        GeometryField        = 1 << 1,
+        WmNameField          = 1 << 2,
+        OrientationField     = 1 << 3,
+        OnlyStatusbarField   = 1 << 4,
+        ShowDialogField      = 1 << 5,
+        AllFields            = (1 << 6) - 1
+    };
+
     /*!
      * Returns the id of the window decorated by this decorator
      */
@@ -68,6 +81,7 @@ public slots:
     void RemoteSetManagedWinId(unsigned, const QRect&, const QString&,
                                unsigned, bool, bool);
     void RemoteSetOnlyStatusbar(bool mode);
+    void RemoteUpdateManagedWin(unsigned changed, const QByteArray &fields);
     void RemoteHideQueryDialog();
     void RemotePlayFeedback(const QString &name);
 
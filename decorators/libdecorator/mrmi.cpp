@@ -22,12 +22,83 @@
 #include <QFile>
 #include <QLocalServer>
 #include <QLocalSocket>
-#include <QBuffer>
 #include <QDataStream>
 #include <QMetaObject>
+#include <QMetaMethod>
+#include <QMetaType>
 #include <QGenericArgument>
 #include <QVariant>
 #include <QPointer>
+#include <QTimer>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QRect>
+#include <QtEndian>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+// Messages are prefixed by their size.  If this bit is set in the size
+// the message is in the binary format:
+//   quint16 method index, quint8 argc, argc * (quint16 type, value)
+// otherwise it's a QDataStream of object name, method name, QVector<QVariant>.
+//
+// The binary format is only used when the other side has told us the
+// indices of its methods in a "methodTable" message, which clients send
+// after "exportObject" and servers answer with their own table.
+static const int BinaryMessage = 0x40000000;
+
+// Once both sides have mapped a shared memory segment (negotiated with
+// the "sharedMemory" message after "methodTable") the messages are put
+// in a ring buffer per direction, in the same format as on the socket.
+// The socket carries only an empty RingDoorbell message to wake up the
+// reader, and only when it may have drained the ring and gone to sleep.
+static const int RingDoorbell = 0x20000000;
+static const int SizeMask = 0x1fffffff;
+static const quint32 RingSize = 64 * 1024;
+
+// How long to wait for the reader to make room in a full ring (ms).
+static const int RingRetryInterval = 5;
+
+// Single-producer single-consumer byte ring.  The indices only grow,
+// the position in @data is their remainder.
+struct MRmiRing
+{
+    volatile quint32 head;  // written by the producer
+    volatile quint32 tail;  // written by the consumer
+    char data[RingSize];
+};
+
+struct MRmiSharedMemory
+{
+    MRmiRing ring[2];       // client to server, server to client
+};
+
+// Shared memory of a peer.  @in and @out are null until both sides
+// have mapped @shm.
+struct MRmiChannel
+{
+    MRmiChannel() : shm(0), in(0), out(0) {}
+    MRmiSharedMemory *shm;
+    MRmiRing *in, *out;
+    QByteArray name;        // the client's until the server has opened it
+};
+
+// Recipients of the binary messages can't take more arguments than this.
+static const int MaxArgs = 10;
+
+// A message waiting to be written by _q_flush().
+struct MRmiMessage
+{
+    QPointer<QLocalSocket> socket;
+    QByteArray method;
+    QByteArray data;
+};
 
 class MRmiPrivate: public QObject
 {
@@ -35,6 +106,7 @@ class MRmiPrivate: public QObject
 
 public:
     MRmiPrivate(const QString &key, bool isServer);
+    ~MRmiPrivate();
 
     void exportObject(QObject* p);
     void invokeRemote(const char* objectName, const char* methodName,
@@ -42,29 +114,63 @@ public:
     void invokeRemote(const char* objectName, const char* methodName,
                       const QVariant &arg);
 
+    QSet<QByteArray> coalesced;
+
 private slots:
     void _q_incoming();
     void _q_readData();
+    void _q_flush();
+    void _q_forgetPeer(QObject *socket);
 
 private:
     void invokeLocal(QLocalSocket* socket, QDataStream& stream);
+    void dispatch(QLocalSocket* socket, int header, const QByteArray &data);
+    void invokeBinary(const QByteArray &message);
+    void send(QLocalSocket* socket, const char* objectName,
+              const char* methodName, const QVector<QVariant> &args);
+    void enqueue(QLocalSocket* socket, const char* methodName,
+                 const QByteArray &data);
+    QByteArray binaryMessage(int index, const QVector<QVariant> &args);
+    QStringList methodTable() const;
+    QByteArray legacyMessage(const char* objectName, const char* methodName,
+                             const QVector<QVariant> &args);
+
+    void offerSharedMemory(QLocalSocket* socket);
+    bool openSharedMemory(QLocalSocket* socket, const QByteArray &name);
+    void closeSharedMemory(QObject* socket);
+    static bool ringWrite(MRmiRing *ring, const QByteArray &data,
+                          bool *was_empty);
+    static void ringRead(const MRmiRing *ring, quint32 pos,
+                         char *dst, quint32 size);
+    void drainRing(QLocalSocket* socket);
 
     QString _key;
     QObject* _obj;
     int method_size;
 
     QPointer<QObject> _server;
-    QBuffer output_buffer;
     QDataStream stream;
 
     QVector<QVariant> args;
+
+    // Remote method signature => method index, for the peers which
+    // speak the binary protocol.
+    QHash<QObject*, QHash<QByteArray, int> > peers;
+    // Parameter types of the methods of @_obj already called.
+    QHash<int, QVector<int> > param_types;
+
+    QHash<QObject*, MRmiChannel> channels;
+
+    QList<MRmiMessage> send_queue;
+    QTimer flush_timer;
 };
 
 MRmiPrivate::MRmiPrivate(const QString &key, bool isServer)
         : _key(key), _obj(0), method_size(0)
 {
     _key = QDir::homePath() + "/" + key;
-    output_buffer.open(QIODevice::WriteOnly);
+    flush_timer.setSingleShot(true);
+    connect(&flush_timer, SIGNAL(timeout()), this, SLOT(_q_flush()));
     if (!isServer)
           return;
 
@@ -94,16 +200,47 @@ MRmiPrivate::MRmiPrivate(const QString &key, bool isServer)
     _server = server;
 }
 
+MRmiPrivate::~MRmiPrivate()
+{
+    // Don't lose what we've been asked to send.
+    _q_flush();
+    foreach (QObject *socket, channels.keys())
+        closeSharedMemory(socket);
+}
+
+QStringList MRmiPrivate::methodTable() const
+{
+    QStringList table;
+    if (!_obj)
+        return table;
+
+    // "<index> <signature>" of the public slots, except QObject's
+    const QMetaObject *mo = _obj->metaObject();
+    for (int i = QObject::staticMetaObject.methodCount();
+         i < mo->methodCount(); ++i) {
+        QMetaMethod m = mo->method(i);
+        if (m.methodType() == QMetaMethod::Slot
+            && m.access() == QMetaMethod::Public)
+            table << QString::number(i) + ' ' + m.signature();
+    }
+    return table;
+}
+
 void MRmiPrivate::exportObject(QObject* p)
 {
     _obj = p;
 
     // If we're a client tell the server what sort of object we have.
-    if (!dynamic_cast<QLocalServer*>(_server.data()))
+    if (!dynamic_cast<QLocalServer*>(_server.data())) {
         invokeRemote("MRmiServer", "exportObject",
                      QVector<QVariant>(1, _obj
                          ? _obj->metaObject()->className()
                          : ""));
+        // and offer to speak binary
+        if (_server)
+            invokeRemote("MRmiServer", "methodTable",
+                         QVector<QVariant>(1, methodTable()));
+    }
 }
 
 void MRmiPrivate::_q_readData()
@@ -126,12 +263,30 @@ void MRmiPrivate::_q_readData()
         }
 
         // Have we got that many?
-        if (socket->bytesAvailable() < method_size)
+        const int size = method_size & SizeMask;
+        if (socket->bytesAvailable() < size)
             return;
 
         // Read and dispatch the message.
+        const int header = method_size;
         method_size = 0;
-        invokeLocal(socket, stream);
+        if (header & RingDoorbell)
+            drainRing(socket);
+        else if (header & BinaryMessage)
+            invokeBinary(socket->read(size));
+        else
+            invokeLocal(socket, stream);
+    }
+}
+
+void MRmiPrivate::dispatch(QLocalSocket* socket, int header,
+                           const QByteArray &data)
+{
+    if (header & BinaryMessage) {
+        invokeBinary(data);
+    } else {
+        QDataStream in(data);
+        invokeLocal(socket, in);
     }
 }
 
@@ -144,7 +299,7 @@ void MRmiPrivate::invokeLocal(QLocalSocket* socket, QDataStream& stream)
     stream >> objectName;
     stream >> methodName;
     stream >> args;
-    args.resize(10);
+    args.resize(MaxArgs);
 
     // Is the message for us?
     if (!objectName || !methodName) {
@@ -152,6 +307,52 @@ void MRmiPrivate::invokeLocal(QLocalSocket* socket, QDataStream& stream)
     } else if (!strcmp(objectName, "MRmiServer") &&
         !strcmp(methodName, "exportObject")) {
         socket->setObjectName(args[0].toString());
+    } else if (!strcmp(objectName, "MRmiServer") &&
+        !strcmp(methodName, "methodTable")) {
+        QHash<QByteArray, int> &methods = peers[socket];
+        methods.clear();
+        foreach (const QString &entry, args[0].toStringList()) {
+            int sep = entry.indexOf(' ');
+            methods.insert(entry.mid(sep + 1).toLatin1(),
+                           entry.left(sep).toInt());
+        }
+        connect(socket, SIGNAL(destroyed(QObject*)),
+                SLOT(_q_forgetPeer(QObject*)), Qt::UniqueConnection);
+
+        // Answer a client with our own table.  A client now knows the
+        // server is new enough to share memory with.
+        if (dynamic_cast<QLocalServer*>(_server.data()))
+            send(socket, "MRmiServer", "methodTable",
+                 QVector<QVariant>(1, methodTable()));
+        else
+            offerSharedMemory(socket);
+    } else if (!strcmp(objectName, "MRmiServer") &&
+        !strcmp(methodName, "sharedMemory")) {
+        if (dynamic_cast<QLocalServer*>(_server.data())) {
+            // A client's offer.  Push out what's queued before we switch
+            // and answer directly so the client hears it on the socket.
+            bool ok = openSharedMemory(socket, args[0].toByteArray());
+            _q_flush();
+            if (ok)
+                channels[socket].in = &channels[socket].shm->ring[0];
+            socket->write(legacyMessage("MRmiServer", "sharedMemory",
+                                        QVector<QVariant>(1, ok)));
+            socket->flush();
+            if (ok)
+                channels[socket].out = &channels[socket].shm->ring[1];
+        } else if (channels.contains(socket)) {
+            // The server's answer.  It has opened the segment if it could,
+            // so nobody needs the name anymore.
+            MRmiChannel &channel = channels[socket];
+            shm_unlink(channel.name.constData());
+            channel.name.clear();
+            if (args[0].toBool()) {
+                channel.out = &channel.shm->ring[0];
+                channel.in = &channel.shm->ring[1];
+                drainRing(socket);
+            } else
+                closeSharedMemory(socket);
+        }
     } else { // Call @methodName on _obj.
         // Copy @args so the invoked method is safe from us modifying it.
         QVector<QVariant> marg = args;
@@ -172,6 +373,411 @@ void MRmiPrivate::invokeLocal(QLocalSocket* socket, QDataStream& stream)
     delete[] methodName;
 }
 
+// Unpack a binary message and call the method directly by its index.
+void MRmiPrivate::invokeBinary(const QByteArray &message)
+{
+    QDataStream in(message);
+    quint16 index;
+    quint8 argc;
+    in >> index >> argc;
+    if (!_obj || index >= _obj->metaObject()->methodCount()
+        || argc > MaxArgs) {
+        qWarning("MRmiPrivate::invokeBinary: don't know what to call");
+        return;
+    }
+
+    QHash<int, QVector<int> >::const_iterator pt = param_types.find(index);
+    if (pt == param_types.end()) {
+        QVector<int> types;
+        foreach (const QByteArray &type,
+                 _obj->metaObject()->method(index).parameterTypes())
+            types << QMetaType::type(type.constData());
+        pt = param_types.insert(index, types);
+    }
+
+    // Unpack the common types in place, the rest through QMetaType.
+    bool b[MaxArgs];
+    int i[MaxArgs];
+    uint u[MaxArgs];
+    QString str[MaxArgs];
+    QRect rect[MaxArgs];
+    void *other[MaxArgs];
+    void *argv[MaxArgs + 1];
+    int n;
+    bool ok = argc == pt->size();
+
+    argv[0] = 0;
+    for (n = 0; n < argc && ok; ++n) {
+        quint16 type;
+        in >> type;
+        other[n] = 0;
+        if (type != pt->at(n)) {
+            ok = false;
+            break;
+        }
+
+        switch (type) {
+        case QMetaType::Bool:
+            in >> b[n];
+            argv[n + 1] = &b[n];
+            break;
+        case QMetaType::Int:
+            in >> i[n];
+            argv[n + 1] = &i[n];
+            break;
+        case QMetaType::UInt:
+            in >> u[n];
+            argv[n + 1] = &u[n];
+            break;
+        case QMetaType::QString:
+            in >> str[n];
+            argv[n + 1] = &str[n];
+            break;
+        case QMetaType::QRect:
+            in >> rect[n];
+            argv[n + 1] = &rect[n];
+            break;
+        default:
+            other[n] = QMetaType::construct(type);
+            ok = other[n] && QMetaType::load(in, type, other[n]);
+            argv[n + 1] = other[n];
+            break;
+        }
+    }
+
+    if (ok && in.status() == QDataStream::Ok)
+        QMetaObject::metacall(_obj, QMetaObject::InvokeMetaMethod,
+                              index, argv);
+    else
+        qWarning("MRmiPrivate::invokeBinary: bad arguments for %s",
+                 _obj->metaObject()->method(index).signature());
+
+    while (n-- > 0)
+        if (other[n])
+            QMetaType::destroy(pt->at(n), other[n]);
+}
+
+// Create a segment and ask the server at @socket to map it too.
+void MRmiPrivate::offerSharedMemory(QLocalSocket* socket)
+{
+    if (channels.contains(socket))
+        return;
+
+    QByteArray name = "/mrmi-" + QByteArray::number(getuid())
+        + '-' + QByteArray::number(getpid());
+    int fd = shm_open(name.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        // Maybe a corpse of a previous process with our pid.
+        shm_unlink(name.constData());
+        fd = shm_open(name.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd < 0) {
+        qWarning("MRmiPrivate: shm_open(%s): %s", name.constData(),
+                 strerror(errno));
+        return;
+    }
+
+    void *shm = MAP_FAILED;
+    if (ftruncate(fd, sizeof(MRmiSharedMemory)) == 0)
+        shm = mmap(0, sizeof(MRmiSharedMemory), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (shm == MAP_FAILED) {
+        qWarning("MRmiPrivate: can't map %s: %s", name.constData(),
+                 strerror(errno));
+        shm_unlink(name.constData());
+        return;
+    }
+
+    // ftruncate() zeroed it.
+    MRmiChannel &channel = channels[socket];
+    channel.shm = static_cast<MRmiSharedMemory*>(shm);
+    channel.name = name;
+    send(socket, "MRmiServer", "sharedMemory", QVector<QVariant>(1, name));
+}
+
+bool MRmiPrivate::openSharedMemory(QLocalSocket* socket,
+                                   const QByteArray &name)
+{
+    closeSharedMemory(socket);
+
+    // Only accept segments we could have created ourselves.
+    if (!name.startsWith("/mrmi-" + QByteArray::number(getuid()) + '-'))
+        return false;
+    int fd = shm_open(name.constData(), O_RDWR, 0);
+    if (fd < 0) {
+        qWarning("MRmiPrivate: shm_open(%s): %s", name.constData(),
+                 strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    void *shm = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == sizeof(MRmiSharedMemory))
+        shm = mmap(0, sizeof(MRmiSharedMemory), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (shm == MAP_FAILED) {
+        qWarning("MRmiPrivate: can't map %s", name.constData());
+        return false;
+    }
+
+    channels[socket].shm = static_cast<MRmiSharedMemory*>(shm);
+    return true;
+}
+
+void MRmiPrivate::closeSharedMemory(QObject* socket)
+{
+    QHash<QObject*, MRmiChannel>::iterator channel = channels.find(socket);
+    if (channel == channels.end())
+        return;
+    if (!channel->in && !channel->name.isEmpty())
+        // The server hasn't answered.
+        shm_unlink(channel->name.constData());
+    munmap(channel->shm, sizeof(MRmiSharedMemory));
+    channels.erase(channel);
+}
+
+// Append @data to @ring if it fits, and tell whether the reader had
+// consumed everything before, in which case it needs to be woken up.
+bool MRmiPrivate::ringWrite(MRmiRing *ring, const QByteArray &data,
+                            bool *was_empty)
+{
+    const quint32 head = ring->head;
+    const quint32 size = data.size();
+    if (RingSize - (head - ring->tail) < size)
+        return false;
+
+    const quint32 pos = head % RingSize;
+    const quint32 first = qMin(size, RingSize - pos);
+    memcpy(ring->data + pos, data.constData(), first);
+    memcpy(ring->data, data.constData() + first, size - first);
+
+    // Publish the data, then look at the reader, who does the opposite
+    // in drainRing(), so one of us is bound to see the other.
+    __sync_synchronize();
+    ring->head = head + size;
+    __sync_synchronize();
+    *was_empty = ring->tail == head;
+    return true;
+}
+
+void MRmiPrivate::ringRead(const MRmiRing *ring, quint32 pos,
+                           char *dst, quint32 size)
+{
+    pos %= RingSize;
+    const quint32 first = qMin(size, RingSize - pos);
+    memcpy(dst, ring->data + pos, first);
+    memcpy(dst + first, ring->data, size - first);
+}
+
+// Execute the messages in the ring of @socket.
+void MRmiPrivate::drainRing(QLocalSocket* socket)
+{
+    QHash<QObject*, MRmiChannel>::const_iterator channel;
+    for (;;) {
+        // Look it up every time, the methods we call may close it.
+        channel = channels.find(socket);
+        if (channel == channels.end() || !channel->in)
+            return;
+        MRmiRing *ring = channel->in;
+
+        __sync_synchronize();
+        const quint32 tail = ring->tail;
+        const quint32 avail = ring->head - tail;
+        if (!avail)
+            return;
+
+        // Don't trust the peer with the size, it's read from memory
+        // it can write.  The writer only publishes whole messages.
+        uchar size[sizeof(int)];
+        int header = 0;
+        if (avail >= sizeof(size) && avail <= RingSize) {
+            ringRead(ring, tail, (char *)size, sizeof(size));
+            header = qFromBigEndian<qint32>(size);
+        }
+        if (avail < sizeof(size) || avail > RingSize
+            || quint32(header & SizeMask) > avail - sizeof(size)) {
+            qWarning("MRmiPrivate::drainRing: corrupt ring, closing it");
+            closeSharedMemory(socket);
+            return;
+        }
+        QByteArray data(header & SizeMask, 0);
+        ringRead(ring, tail + sizeof(size), data.data(), data.size());
+
+        // Make room for the writer before calling anything.
+        __sync_synchronize();
+        ring->tail = tail + sizeof(size) + data.size();
+        dispatch(socket, header, data);
+    }
+}
+
+// Returns an empty array if @args can't be sent in the binary format.
+QByteArray MRmiPrivate::binaryMessage(int index, const QVector<QVariant> &args)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+
+    // Leave room for the size.
+    out << int(0) << quint16(index) << quint8(args.size());
+    foreach (const QVariant &arg, args) {
+        int type = arg.userType();
+        out << quint16(type);
+        switch (type) {
+        case QMetaType::Bool:
+            out << arg.toBool();
+            break;
+        case QMetaType::Int:
+            out << arg.toInt();
+            break;
+        case QMetaType::UInt:
+            out << arg.toUInt();
+            break;
+        case QMetaType::QString:
+            out << arg.toString();
+            break;
+        case QMetaType::QRect:
+            out << arg.toRect();
+            break;
+        default:
+            if (!QMetaType::save(out, type, arg.constData()))
+                return QByteArray();
+            break;
+        }
+    }
+
+    out.device()->seek(0);
+    out << int((data.size() - sizeof(int)) | BinaryMessage);
+    return data;
+}
+
+// Serialize the message prefixed by its size.
+QByteArray MRmiPrivate::legacyMessage(const char* objectName,
+                                      const char* methodName,
+                                      const QVector<QVariant> &args)
+{
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out << objectName;
+    out << methodName;
+    out << args;
+    QByteArray data;
+    QDataStream(&data, QIODevice::WriteOnly) << message.size();
+    data += message;
+    return data;
+}
+
+void MRmiPrivate::send(QLocalSocket* socket, const char* objectName,
+                       const char* methodName,
+                       const QVector<QVariant> &args)
+{
+    QHash<QObject*, QHash<QByteArray, int> >::const_iterator peer;
+    peer = peers.find(socket);
+
+    if (peer != peers.end()) {
+        // Does the peer know @methodName with these arguments?
+        QByteArray signature(methodName);
+        signature += '(';
+        for (int i = 0; i < args.size(); ++i) {
+            if (i)
+                signature += ',';
+            signature += args[i].typeName();
+        }
+        signature += ')';
+
+        int index = peer->value(signature, -1);
+        if (index >= 0 && args.size() <= MaxArgs) {
+            QByteArray data = binaryMessage(index, args);
+            if (!data.isEmpty()) {
+                enqueue(socket, methodName, data);
+                return;
+            }
+        }
+    }
+
+    QByteArray data = legacyMessage(objectName, methodName, args);
+    if (peer != peers.end()) {
+        // Keep it in order with the binary messages.
+        enqueue(socket, methodName, data);
+        return;
+    }
+
+    // The peer doesn't know the binary protocol (yet), send it the old way.
+    // Flush the pipe.  We need to be kind of reentrant because
+    // waitForBytesWritten() spins the main loop and we might start
+    // processing incoming messages, which in turn may send some.
+    socket->write(data);
+    socket->waitForBytesWritten();
+}
+
+void MRmiPrivate::enqueue(QLocalSocket* socket, const char* methodName,
+                          const QByteArray &data)
+{
+    // Replace the previous call if nothing has been queued since.
+    if (!send_queue.isEmpty() && coalesced.contains(methodName)) {
+        MRmiMessage &last = send_queue.last();
+        if (last.socket == socket && last.method == methodName) {
+            last.data = data;
+            return;
+        }
+    }
+
+    MRmiMessage message;
+    message.socket = socket;
+    message.method = methodName;
+    message.data = data;
+    send_queue.append(message);
+    if (!flush_timer.isActive())
+        flush_timer.start(0);
+}
+
+// Hand the queued messages to the shared memory or the sockets, which
+// write them out without blocking as the receiver consumes them.
+void MRmiPrivate::_q_flush()
+{
+    QSet<QLocalSocket*> sockets, doorbells;
+    while (!send_queue.isEmpty()) {
+        const MRmiMessage &message = send_queue.first();
+        QLocalSocket *socket = message.socket;
+        MRmiRing *ring = socket ? channels.value(socket).out : 0;
+        if (ring) {
+            bool was_empty;
+            if (ringWrite(ring, message.data, &was_empty)) {
+                if (was_empty)
+                    doorbells.insert(socket);
+            } else if ((quint32)message.data.size() <= RingSize
+                       || ring->tail != ring->head) {
+                // Wait for the reader to make room, or in case of a huge
+                // message, to read everything before it.
+                flush_timer.start(RingRetryInterval);
+                break;
+            } else {
+                socket->write(message.data);
+                sockets.insert(socket);
+            }
+        } else if (socket) {
+            socket->write(message.data);
+            sockets.insert(socket);
+        }
+        send_queue.removeFirst();
+    }
+
+    foreach (QLocalSocket *socket, doorbells) {
+        QByteArray doorbell;
+        QDataStream(&doorbell, QIODevice::WriteOnly) << RingDoorbell;
+        socket->write(doorbell);
+        sockets.insert(socket);
+    }
+    foreach (QLocalSocket *socket, sockets)
+        socket->flush();
+}
+
+void MRmiPrivate::_q_forgetPeer(QObject *socket)
+{
+    peers.remove(socket);
+    closeSharedMemory(socket);
+}
+
 void MRmiPrivate::invokeRemote(const char* objectName,
                                const char* methodName,
                                const QVector<QVariant> &args)
@@ -213,25 +819,7 @@ void MRmiPrivate::invokeRemote(const char* objectName,
         // We're a client connected to _server.
         socket = static_cast<QLocalSocket*>(_server.data());
 
-    // Count the number of bytes of the serialized message.
-    QByteArray &buf = output_buffer.buffer();
-    Q_ASSERT(!buf.size());
-    stream.setDevice(&output_buffer);
-    stream << objectName;
-    stream << methodName;
-    stream << args;
-
-    // Send the message prefixed by its size.
-    stream.setDevice(socket);
-    stream << buf.size();
-    socket->write(buf);
-
-    // Flush the pipe.  We need to be kind of reentrant because
-    // waitForBytesWritten() spins the main loop and we might start
-    // processing incoming messages, which in turn may send some.
-    buf.truncate(0);
-    output_buffer.seek(0);
-    socket->waitForBytesWritten();
+    send(socket, objectName, methodName, args);
 }
 
 void MRmiPrivate::invokeRemote(const char* objectName,
@@ -286,4 +874,12 @@ void MRmi::invoke(const char* objectName, const char* methodName,
     d_ptr->invokeRemote(objectName, methodName, arg);
 }
 
+void MRmi::setCoalesced(const char* methodName, bool coalesced)
+{
+    if (coalesced)
+        d_ptr->coalesced.insert(methodName);
+    else
+        d_ptr->coalesced.remove(methodName);
+}
+
 #include "moc_mrmi.cpp"
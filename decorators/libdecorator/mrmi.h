@@ -60,6 +60,15 @@ public:
     void invoke(const char* objectName, const char* methodName)
     { invoke(objectName, methodName, QVector<QVariant>()); }
 
+    /*!
+     * Allow a call of \a methodName to replace the previous one if that
+     * hasn't been sent yet and nothing else has been invoked since.  Use it
+     * for methods which set some state, where only the last value matters.
+     * This only takes effect once the remote side has agreed to use the
+     * binary protocol, otherwise every call is sent right away.
+     */
+    void setCoalesced(const char* methodName, bool coalesced = true);
+
 private:
     Q_DISABLE_COPY(MRmi)
 
@@ -1,6 +1,8 @@
 // Instances of XServerPinger send some simple X requests periodically
-// and warn no reply arrives until the next ping.
+// and warn no reply arrives until the next ping.  The round-trip times
+// are recorded in MXServerLatency for the compositor's dumpState().
 #include "xserverpinger.h"
+#include "mxserverlatency.h"
 
 #include <QCoreApplication>
 #include <QSocketNotifier>
@@ -16,8 +18,14 @@
 #include <sys/prctl.h>
 #include <sys/signalfd.h>
 
+// Ping this many times more often while the compositor is drawing.
+static const int BusyRate = 10;
+// And this many times less often while the display is off.
+static const int SleepRate = 12;
+
 // Ping X in @pingInterval miliseconds.
 XServerPinger::XServerPinger(int pingInterval)
+    : interval(pingInterval), stalled(false)
 {
     Display *dpy;
     sigset_t sigs;
@@ -28,11 +36,17 @@ XServerPinger::XServerPinger(int pingInterval)
     connect(new QSocketNotifier(ConnectionNumber(dpy), QSocketNotifier::Read),
             SIGNAL(activated(int)), SLOT(xInput(int)));
 
+    stats = MXServerLatency::instance();
+    if (stats)
+        stats->reset();
+
     // XGetInputFocus() is our ping request.
     request = xcb_get_input_focus(xcb);
+    sent_us = MXServerLatency::now_us();
     xcb_flush(xcb);
 
     timer = new QTimer();
+    timer->setSingleShot(true);
     connect(timer, SIGNAL(timeout()), SLOT(tick()));
     timer->start(pingInterval);
 
@@ -62,6 +76,8 @@ void XServerPinger::xInput(int)
         if (reply) {
             free(reply);
             request.sequence = 0;
+            if (stats)
+                stats->record(MXServerLatency::now_us() - sent_us);
         } else if (error)
             // Ignore
             free(error);
@@ -70,13 +86,30 @@ void XServerPinger::xInput(int)
 
 void XServerPinger::tick()
 {
+    if (stats && stats->sleeping) {
+        // Nobody's looking, don't wake up the device for nothing.
+        timer->start(interval * SleepRate);
+        return;
+    }
+
     if (!request.sequence) {
         // Last ping was successful, keep pinging.
         request = xcb_get_input_focus(xcb);
+        sent_us = MXServerLatency::now_us();
         xcb_flush(xcb);
-    } else
+        stalled = false;
+    } else if (!stalled
+               && MXServerLatency::now_us() - sent_us >= interval * 1000) {
         // Ping timed out
         qWarning("X is on holidays");
+        stalled = true;
+        if (stats)
+            stats->stalled();
+    }
+
+    // Sample more often when a stall would be visible.
+    timer->start(stats && stats->drawnWithin(interval)
+                 ? interval / BusyRate : interval);
 }
 
 void XServerPinger::die(int)
@@ -6,6 +6,8 @@
 
 #include <xcb/xcb.h>
 
+struct MXServerLatency;
+
 class XServerPinger: public QObject
 {
     Q_OBJECT
@@ -16,6 +18,11 @@ protected:
     xcb_connection_t *xcb;
     xcb_get_input_focus_cookie_t request;
     QTimer *timer;
+    int interval;
+    // When @request was sent.
+    qint64 sent_us;
+    MXServerLatency *stats;
+    bool stalled;
 
 public slots:
     void xInput(int);
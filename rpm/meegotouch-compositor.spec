@@ -162,6 +162,7 @@ fi
 %{_bindir}/windowctl
 %{_bindir}/windowstack
 %{_bindir}/manual-splash
+%{_bindir}/mcreplay
 # >> files tools
 # << files tools
 
@@ -91,6 +91,10 @@ public:
         // misc
         _NET_WM_PID,
         _NET_WM_PING,
+        _NET_WM_SYNC_REQUEST,
+        _NET_WM_SYNC_REQUEST_COUNTER,
+        _NET_WM_FRAME_DRAWN,
+        _NET_WM_FRAME_TIMINGS,
 
         // root messages
         _NET_ACTIVE_WINDOW,
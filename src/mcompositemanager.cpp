@@ -50,10 +50,17 @@
 #include "mcompositordebug.h"
 #include "msplashscreen.h"
 #include "mcompositewindowanimation.h"
+#include "mtimerwheel.h"
+#include "mxserverlatency.h"
+#include "mjsonwriter.h"
+#include "meventrecorder.h"
 
 #include <QX11Info>
 #include <QByteArray>
 #include <QVector>
+#include <QSet>
+#include <QFile>
+#include <QDataStream>
 #include <QtPlugin>
 
 #include <X11/Xutil.h>
@@ -65,11 +72,14 @@
 #include <X11/Xmd.h>
 #include <X11/XKBlib.h>
 #include <X11/Xproto.h>
+#include <X11/extensions/sync.h>
 #include "mcompatoms_p.h"
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <time.h>
+#include <limits.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -115,9 +125,17 @@ static QHash<QLatin1String, QVariant> default_settings;
 static bool should_be_pinged(MCompositeWindow *cw);
 static bool compareWindows(Window w_a, Window w_b);
 
+static inline quint64 now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return quint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 #ifdef WINDOW_DEBUG
 static QTime overhead_measure;
 static bool debug_mode = false; // this can be toggled with SIGUSR1
+
 template<class T>
 static QString dumpWindows(const T &wins, bool leftToRight=true,
                            const char *sep=", ", bool prefix=false);
@@ -419,12 +437,14 @@ MCompositeManagerPrivate::MCompositeManagerPrivate(MCompositeManager *p)
       prev_focus(0),
       glwidget(0),
       desktop_window(0),
+      sync_event(-1),
       compositing(true),
       changed_properties(false),
-      orientationProvider(p->configInt("default-desktop-angle")),
+      orientationProvider(p->cfg().default_desktop_angle),
       prepared(false),
       stacking_timeout_check_visibility(false),
       stacking_timeout_timestamp(CurrentTime),
+      recorder(0),
       splash(0),
       lastDestroyedSplash(0, 0),
       defaultGraphicsAlpha(MAXIMUM_GLOBAL_ALPHA),
@@ -447,6 +467,18 @@ MCompositeManagerPrivate::MCompositeManagerPrivate(MCompositeManager *p)
             this, SLOT(callOngoing(bool)));
     stacking_timer.setSingleShot(true);
     connect(&stacking_timer, SIGNAL(timeout()), this, SLOT(stackingTimeout()));
+    damage_timer.setSingleShot(true);
+    connect(&damage_timer, SIGNAL(timeout()), this, SLOT(repairPendingDamage()));
+    notify_timer.setSingleShot(true);
+    connect(&notify_timer, SIGNAL(timeout()),
+            this, SLOT(flushNotifications()));
+    deep_sleep = false;
+    unblank_timer.setSingleShot(true);
+    connect(&unblank_timer, SIGNAL(timeout()), this, SLOT(finishUnblank()));
+    unredirect_now = false;
+    unredirect_timer.setSingleShot(true);
+    connect(&unredirect_timer, SIGNAL(timeout()),
+            this, SLOT(unredirectTimeout()));
 }
 
 MCompositeManagerPrivate::~MCompositeManagerPrivate()
@@ -456,6 +488,7 @@ MCompositeManagerPrivate::~MCompositeManagerPrivate()
         XDeleteProperty(QX11Info::display(), QX11Info::appRootWindow(),
                         ATOM(_NET_SUPPORTING_WM_CHECK));
 
+    delete recorder;
     delete watch;
     watch = 0;
 }
@@ -492,8 +525,8 @@ static void setup_key_grabs()
     Display* dpy = QX11Info::display();
     static bool ignored_mod = false;
     if (!switcher_key) {
-        QString k = static_cast<MCompositeManager*>(qApp)->config(
-                                          "switcher-keysym").toString();
+        const QString &k = static_cast<MCompositeManager*>(qApp)->cfg()
+                                                   .switcher_keysym;
         switcher_key = XKeysymToKeycode(dpy,
                              XStringToKeysym(k.toLatin1().constData()));
         XGrabKey(dpy, switcher_key, Mod5Mask,
@@ -567,6 +600,13 @@ void MCompositeManagerPrivate::prepare()
 
     XDamageQueryExtension(QX11Info::display(), &damage_event, &damage_error);
 
+    int sync_error, major, minor;
+    if (!XSyncQueryExtension(QX11Info::display(), &sync_event, &sync_error)
+        || !XSyncInitialize(QX11Info::display(), &major, &minor)) {
+        qWarning("%s: no XSync, _NET_WM_SYNC_REQUEST is disabled", __func__);
+        sync_event = -1;
+    }
+
     prepared = true;
 }
 
@@ -623,21 +663,54 @@ bool MCompositeManagerPrivate::needDecoration(MWindowPropertyCache *pc)
 void MCompositeManagerPrivate::damageEvent(XDamageNotifyEvent *e)
 {
     MCompositeWindow *item = COMPOSITE_WINDOW(e->drawable);
+    counters.damage_events++;
     if (item) {
         item->propertyCache()->damageReceived();
 
-        /* partial updates disabled for now, does not always work, unless we
-         * check for EGL_BUFFER_PRESERVED or GLX_SWAP_COPY_OML first, see
-         * http://www.khronos.org/registry/egl/specs/EGLTechNote0001.html and
-         * http://www.opengl.org/registry/specs/OML/glx_swap_method.txt */
-        if (((item->isVisible() || !item->paintedAfterMapping())
-             && !device_state->displayOff())
-            || item->propertyCache()->isLockScreen())
-            item->updateWindowPixmap(0, 0, e->timestamp);
-        item->damageReceived();
+        // Windows we're waiting to show count the damages they get and
+        // the lockscreen must be repaired right away, otherwise just
+        // note the damage and repair it once the current batch of X
+        // events has been processed.
+        if (item->propertyCache()->waitingForDamage()
+            || item->propertyCache()->isLockScreen()) {
+            repairDamage(item, e->timestamp);
+            return;
+        }
+        pending_damage[e->drawable] = e->timestamp;
+        if (!damage_timer.isActive())
+            damage_timer.start();
+    }
+}
+
+// Repair the damages accumulated by damageEvent(), once per window.
+void MCompositeManagerPrivate::repairPendingDamage()
+{
+    const QHash<Window, Time> damaged = pending_damage;
+    pending_damage.clear();
+    for (QHash<Window, Time>::const_iterator it = damaged.constBegin();
+         it != damaged.constEnd(); ++it) {
+        MCompositeWindow *item = COMPOSITE_WINDOW(it.key());
+        if (item)
+            repairDamage(item, it.value());
     }
 }
 
+void MCompositeManagerPrivate::repairDamage(MCompositeWindow *item, Time t)
+{
+    /* partial updates disabled for now, does not always work, unless we
+     * check for EGL_BUFFER_PRESERVED or GLX_SWAP_COPY_OML first, see
+     * http://www.khronos.org/registry/egl/specs/EGLTechNote0001.html and
+     * http://www.opengl.org/registry/specs/OML/glx_swap_method.txt */
+    counters.repairs++;
+    if (((item->isVisible() || !item->paintedAfterMapping())
+         && !device_state->displayOff())
+        || item->propertyCache()->isLockScreen()
+        // keep it ready for the display to be turned on
+        || item->propertyCache()->lowPowerMode())
+        item->updateWindowPixmap(0, 0, t);
+    item->damageReceived();
+}
+
 void MCompositeManagerPrivate::createEvent(XCreateWindowEvent *e)
 {
     if (localwin == e->window || xoverlay == e->window)
@@ -672,6 +745,8 @@ void MCompositeManagerPrivate::destroyEvent(XDestroyWindowEvent *e)
         }
         removeWindow(e->window);
     }
+    forgetNotifications(e->window);
+    sleep_log.properties.remove(e->window);
 }
 
 void MCompositeManagerPrivate::splashTimeout()
@@ -699,6 +774,13 @@ check_compositing_and_stacking:
         orientationProvider.updateCurrentWindowOrienationAngle(pc);
 }
 
+// The settings have been reloaded, update what the windows took from them.
+void MCompositeManagerPrivate::applyConfig()
+{
+    foreach (MCompositeWindow *cw, windows)
+        cw->applyConfig();
+}
+
 void MCompositeManagerPrivate::propertyEvent(XPropertyEvent *e)
 {
     MWindowPropertyCache *pc;
@@ -775,7 +857,32 @@ void MCompositeManagerPrivate::propertyEvent(XPropertyEvent *e)
         return;
     }
 
-    if (pc->propertyEvent(e) && pc->isMapped()) {
+    // The cache is kept up to date even while asleep, the lockscreen
+    // is recognised by its properties.
+    bool affects_stacking = pc->propertyEvent(e);
+    if (deep_sleep && e->atom != ATOM(WM_NAME)
+        && e->atom != ATOM(_MEEGO_STACKING_LAYER)
+        && !pc->isLockScreen() && !pc->lowPowerMode()) {
+        // see to it when the display is turned on
+        SleepLog::Change &change = sleep_log.properties[e->window][e->atom];
+        change.state = e->state;
+        change.affects_stacking |= affects_stacking;
+        counters.sleep_deferred++;
+        return;
+    }
+    if (deep_sleep && sleep_log.properties.contains(e->window))
+        // it has just turned out to be the lockscreen, catch up with it
+        replayProperties(e->window, sleep_log.properties.take(e->window));
+    propertyChanged(e, pc, affects_stacking);
+}
+
+// React to the change of a property of @pc's window.  @affects_stacking
+// is what the property cache said about it.
+void MCompositeManagerPrivate::propertyChanged(XPropertyEvent *e,
+                                               MWindowPropertyCache *pc,
+                                               bool affects_stacking)
+{
+    if (affects_stacking && pc->isMapped()) {
         bool recheck_visibility = false;
         changed_properties = true; // property change can affect stacking order
         if (pc->isDecorator())
@@ -806,6 +913,17 @@ void MCompositeManagerPrivate::propertyEvent(XPropertyEvent *e)
                 enableCompositing();
         }
     }
+    if (e->atom == ATOM(_MEEGOTOUCH_OPAQUE_WINDOW)) {
+        MCompositeWindow *cw = COMPOSITE_WINDOW(e->window);
+        if (cw)
+            cw->updateTranslucency();
+    }
+    if (e->atom == ATOM(_NET_WM_SYNC_REQUEST_COUNTER)) {
+        // The frame alarm is on the old counter.
+        MCompositeWindow *cw = COMPOSITE_WINDOW(e->window);
+        if (cw)
+            cw->watchFrames();
+    }
 
     // global alpha events here. TODO: property cache class could handle this
     // but it is straightforward to manipulate it from here
@@ -951,6 +1069,16 @@ bool MCompositeManagerPrivate::haveMappedWindow() const
     return false;
 }
 
+// Whether @w is in @being_mapped and still exists.
+bool MCompositeManagerPrivate::isBeingMapped(const QSet<Window> &being_mapped,
+                                             Window w) const
+{
+    if (!being_mapped.contains(w))
+        return false;
+    MWindowPropertyCache *pc = prop_caches.value(w, 0);
+    return pc && pc->is_valid;
+}
+
 bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
 {
     if (watch->keep_black || (splash && !device_state->displayOff()))
@@ -964,13 +1092,30 @@ bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
     Window top = 0;
     int win_i = -1;
     MCompositeWindow *cw = 0;
+    // Shaped windows above @top whose holes it fills, and the part of the
+    // screen covered by them and the docks and OR windows above.
+    QList<Window> partial;
+    QRegion covered, shape;
+    // Windows we've called XMapWindow() for but haven't got the MapNotify
+    // of prevent disabling compositing, unless they're below the desktop.
+    const QSet<Window> &being_mapped = MWindowPropertyCache::beingMappedWindows();
     for (int i = stacking_list.size() - 1; i >= 0; --i) {
         Window w = stacking_list.at(i);
+        if (w != desktop_window && isBeingMapped(being_mapped, w))
+            return false;
         if (!(cw = COMPOSITE_WINDOW(w))
                 || (!splash && cw->type() == MSplashScreen::Type)
-                || cw->propertyCache()->isInputOnly()
-                || cw->propertyCache()->isOverrideRedirect())
+                || cw->propertyCache()->isInputOnly())
             continue;
+        if (cw->propertyCache()->isOverrideRedirect()) {
+            // these are unredirected along with @top anyway
+            if (cw->isMapped() && !cw->needsCompositing()) {
+                shape = cw->propertyCache()->shapeRegion();
+                shape.translate(cw->propertyCache()->realGeometry().topLeft());
+                covered += shape & fs_r;
+            }
+            continue;
+        }
         if (w == desktop_window) {
             top = w;
             win_i = i;
@@ -991,38 +1136,71 @@ bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
             return false;
         if (!cw->paintedAfterMapping() && cw->propertyCache()->isMapped())
             return false;
-        if (cw->isMapped() && (cw->needsCompositing()
-            // FIXME: implement direct rendering for shaped windows
-            || !fs_r.subtracted(cw->propertyCache()->shapeRegion()).isEmpty()))
+        if (!cw->isMapped())
+            continue;
+        // the shape is relative to the window
+        shape = cw->propertyCache()->shapeRegion();
+        shape.translate(cw->propertyCache()->realGeometry().topLeft());
+        shape &= fs_r;
+        if ((shape - covered).isEmpty())
+            // hidden by the windows above or off-screen
+            continue;
+        if (cw->needsCompositing())
             // this window prevents direct rendering
             return false;
-        // it is a fullscreen, non-transparent window of any type
-        if (cw->isMapped()) {
+        // It is a non-transparent window of any type.  Unredirect it if it
+        // covers the rest of the screen.
+        covered += shape;
+        if (fs_r.subtracted(covered).isEmpty()) {
             top = w;
             win_i = i;
             break;
         }
-    }
-
-    // this code prevents us disabling compositing when we have a window
-    // that has XMapWindow() called but we have not yet received the MapNotify
-    for (int i = stacking_list.size() - 1; i >= 0; --i) {
-        Window w = stacking_list.at(i);
-        if (w == desktop_window) break;
-        MWindowPropertyCache *pc = prop_caches.value(w, 0);
-        if (pc && pc->is_valid && pc->beingMapped())
+        if (cw->propertyCache()->windowTypeAtom()
+                                      == ATOM(_NET_WM_WINDOW_TYPE_DOCK))
+            continue;
+        if (!fs_r.subtracted(covered + cw->propertyCache()->realGeometry())
+                 .isEmpty()
+            || cw->propertyCache()->windowTypeAtom()
+                                      == ATOM(_NET_WM_WINDOW_TYPE_INPUT))
+            // smaller than the screen, or the VKB which wants to composite
+            // its client window
             return false;
+        // The windows below show through the holes of its shape, they
+        // can be direct-rendered too.
+        partial.append(w);
     }
+
+    // The windows above the desktop which are hidden by @top haven't been
+    // looked at yet.
+    if (!being_mapped.isEmpty() && win_i >= 0 && top != desktop_window)
+        for (int i = win_i - 1; i >= 0; --i) {
+            Window w = stacking_list.at(i);
+            if (w == desktop_window)
+                break;
+            if (isBeingMapped(being_mapped, w))
+                return false;
+        }
     if (!haveMappedWindow()) {
         if (splash || device_state->displayOff()
             || MCompositeWindow::hasTransitioningWindow())
             return false;
+        if (compositing && holdCompositing())
+            return false;
+        const quint64 start = now_ns();
+        const bool was_compositing = compositing;
         showOverlayWindow(false);
         compositing = false;
+        if (was_compositing)
+            switched(false, start);
         return true;
     }
 
     if (top && cw && !MCompositeWindow::hasTransitioningWindow()) {
+        if (compositing && holdCompositing())
+            return false;
+        const quint64 start = now_ns();
+        const bool was_compositing = compositing;
 #ifdef GLES2_VERSION
         if (compositing) {
             showOverlayWindow(false);
@@ -1040,8 +1218,8 @@ bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
                 ((MTexturePixmapItem*)p_cw)->enableRedirectedRendering();
                 setWindowDebugProperties(parent);
             }
-        // unredirect the chosen window and any docks and OR windows above it
-        // TODO: what else should be unredirected?
+        // unredirect the chosen window, the shaped windows above it and
+        // any docks and OR windows above it
         if (!((MTexturePixmapItem *)cw)->isDirectRendered()) {
             ((MTexturePixmapItem *)cw)->enableDirectFbRendering();
             setWindowDebugProperties(top);
@@ -1051,7 +1229,8 @@ bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
             if ((cw = COMPOSITE_WINDOW(w)) && cw->isMapped() &&
                 (cw->propertyCache()->windowTypeAtom()
                                    == ATOM(_NET_WM_WINDOW_TYPE_DOCK)
-                 || cw->propertyCache()->isOverrideRedirect())) {
+                 || cw->propertyCache()->isOverrideRedirect()
+                 || partial.contains(w))) {
                 if (!((MTexturePixmapItem *)cw)->isDirectRendered()) {
                     ((MTexturePixmapItem *)cw)->enableDirectFbRendering();
                     setWindowDebugProperties(w);
@@ -1064,11 +1243,74 @@ bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
             compositing = false;
         }
 #endif
+        if (was_compositing)
+            switched(false, start);
         ret = true;
     }
     return ret;
 }
 
+// How long to keep compositing after it's become unnecessary.  If direct
+// rendering hasn't been lasting long lately, we're likely to need to
+// composite again soon, so wait about that long.
+int MCompositeManagerPrivate::holdTime() const
+{
+    const MCompositeManager::Config &c =
+        static_cast<MCompositeManager*>(qApp)->cfg();
+    int hold = c.unredirect_delay;
+    if (switches.direct_avg_ms >= 0
+        && switches.direct_avg_ms < c.unredirect_max_delay)
+        hold = qMax(hold, switches.direct_avg_ms);
+    return qMin(hold, c.unredirect_max_delay);
+}
+
+// Returns whether to keep compositing for now even though we could render
+// directly.  @unredirect_timer will try again.
+bool MCompositeManagerPrivate::holdCompositing()
+{
+    if (unredirect_now || device_state->displayOff())
+        return false;
+    if (unredirect_timer.isActive())
+        return true;
+    const int hold = holdTime();
+    if (hold <= 0)
+        return false;
+    switches.held++;
+    unredirect_timer.start(hold);
+    return true;
+}
+
+void MCompositeManagerPrivate::unredirectTimeout()
+{
+    unredirect_now = true;
+    if (!possiblyUnredirectTopmostWindow() && !compositing)
+        enableCompositing();
+    unredirect_now = false;
+}
+
+// Account a switch which started at @start_ns.
+void MCompositeManagerPrivate::switched(bool to_compositing, quint64 start_ns)
+{
+    const quint64 took = (now_ns() - start_ns) / 1000;
+
+    if (to_compositing) {
+        switches.to_composited++;
+        if (switches.since.isValid()) {
+            // Anything longer than a minute is long.
+            int ms = qMin(switches.since.elapsed(), qint64(60000));
+            switches.direct_avg_ms = switches.direct_avg_ms < 0 ? ms
+                : (3 * switches.direct_avg_ms + ms) / 4;
+        }
+    } else {
+        switches.to_direct++;
+        unredirect_timer.stop();
+    }
+    switches.since.start();
+    switches.total_us += took;
+    if (took > switches.max_us)
+        switches.max_us = took;
+}
+
 void MCompositeManagerPrivate::unmapEvent(XUnmapEvent *e)
 {
     // if desktop window was unmapped we need to set the appropriate context
@@ -1411,21 +1653,21 @@ void MCompositeManagerPrivate::mapRequestEvent(XMapRequestEvent *e)
 
                 // unredirect the input method window if possible
                 unredir = !pc->hasAlphaAndIsNotOpaque();
-                if (compositing) {
+                if (compositing && unredir)
                     // It's not if we're showing any hasAlphaAndIsNotOpaque()
                     // windows, for example notifications.  If we did unredir,
                     // those windows would disappear until we realize our
                     // mistake and undo.
-                    QHash<Window, MCompositeWindow*>::const_iterator it;
-                    for (it = windows.begin();
-                         unredir && it != windows.end(); ++it)
-                        unredir = !it.value()->isVisible() || !it.value()->propertyCache()->hasAlphaAndIsNotOpaque();
-                }
+                    unredir = !MCompositeWindow::hasVisibleTranslucentWindow();
+                if (unredir && compositing && holdCompositing())
+                    unredir = false;
             }
             if (unredir) {
                 if (compositing) {
+                    const quint64 start = now_ns();
                     showOverlayWindow(false);
                     compositing = false;
+                    switched(false, start);
                 }
                 MCompositeWindow *cw = COMPOSITE_WINDOW(e->window);
                 if (cw) {
@@ -1678,6 +1920,8 @@ void MCompositeManagerPrivate::checkInputFocus(Time timestamp)
 void MCompositeManagerPrivate::dirtyStacking(bool force_visibility_check,
                                              Time timestamp)
 {
+    if (deferWhileAsleep(force_visibility_check, timestamp))
+        return;
     if (timestamp != CurrentTime)
         stacking_timeout_timestamp = timestamp;
     if (force_visibility_check)
@@ -1920,6 +2164,9 @@ void MCompositeManagerPrivate::setStatusbarVisibleProperty(bool visible)
 void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
                                              Time timestamp)
 {
+    if (deferWhileAsleep(force_visibility_check, timestamp))
+        return;
+    counters.stacking_checks++;
     if (stacking_timer.isActive()) {
         if (stacking_timeout_check_visibility) {
             force_visibility_check = true;
@@ -2068,6 +2315,7 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
     }
     setCurrentApp(set_as_current_app, restacked || changed_properties);
     changed_properties = false;
+    flushNotifications();
 }
 
 void MCompositeManagerPrivate::stackingTimeout()
@@ -2356,7 +2604,7 @@ void MCompositeManagerPrivate::rootMessageEvent(XClientMessageEvent *event)
             pc->setStackedUnmapped(true);
         } else if (pc->isMapped()) {
             Window topmost = getTopmostApp();
-            if (!m_extensions.values(MapNotify).isEmpty() || !topmost) {
+            if (!ext_dispatch[MapNotify].isEmpty() || !topmost) {
                 // Not necessary to animate if not in desktop view or we have a plugin.
                 Window raise = event->window;
                 bool needComp = false;
@@ -2369,7 +2617,7 @@ void MCompositeManagerPrivate::rootMessageEvent(XClientMessageEvent *event)
                 if (i && (i->propertyCache()->windowState() == IconicState
                           // if it's not iconic, let the plugin decide
                           || (raise != topmost &&
-                              !m_extensions.values(MapNotify).isEmpty()))) {
+                              !ext_dispatch[MapNotify].isEmpty()))) {
                     if (skipStartupAnim(i->propertyCache(), true)) {
                         STACKING("positionWindow 0x%lx -> top", i->window());
                         positionWindow(i->window(), true);
@@ -2747,7 +2995,12 @@ MWindowPropertyCache *MCompositeManagerPrivate::findLockScreen() const
 
 void MCompositeManagerPrivate::displayOff(bool display_off)
 {
+    MCompositeManager *p = static_cast<MCompositeManager*>(qApp);
     if (display_off) {
+        if (unblank_timer.isActive()) {
+            unblank_timer.stop();
+            finishUnblank();
+        }
         if (splash)
             splashTimeout();
         if (!haveMappedWindow())
@@ -2780,33 +3033,192 @@ void MCompositeManagerPrivate::displayOff(bool display_off)
         for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
              it != windows.end(); ++it) {
              MCompositeWindow *i = it.value();
+             pc = i->propertyCache();
              i->stopPing();
              if (i->windowAnimator() && i->windowAnimator()->isActive())
                  i->windowAnimator()->finish();
-             // stop damage tracking while the display is off
-             if (i->propertyCache() &&
+             // stop damage tracking while the display is off, except for
+             // the windows shown first when it's turned on
+             if (pc && p->cfg().instant_unblank
+                 && (pc->isLockScreen() || pc->lowPowerMode()))
+                 continue;
+             if (pc &&
                  // don't disturb unmapped or waiting-for-damage lockscreen
-                 (!i->propertyCache()->isLockScreen()
-                  || (i->propertyCache()->isMapped()
-                      && i->paintedAfterMapping())))
-                 i->propertyCache()->damageTracking(false);
+                 (!pc->isLockScreen()
+                  || (pc->isMapped() && i->paintedAfterMapping())))
+                 pc->damageTracking(false);
+        }
+
+        if (p->cfg().deep_sleep) {
+            // Obscure the windows now, then only what's needed for the
+            // lockscreen and low-power mode windows is done until the
+            // display is turned on.
+            checkStacking(true);
+            deep_sleep = true;
+            if (MXServerLatency *latency = MXServerLatency::instance())
+                latency->setSleeping(true);
+            return;
         }
+        dirtyStacking(true);  // VisibilityNotify generation
     } else {
+        const quint64 start = now_ns();
+        if (p->cfg().instant_unblank && unblankReady()) {
+            // Present what's been kept ready first and catch up afterwards.
+            watch->keep_black = false;
+            if (!possiblyUnredirectTopmostWindow()) {
+                if (!compositing) {
+                    enableCompositing();
+                } else {
+                    // updates were frozen while keeping black
+                    scene()->views()[0]->setUpdatesEnabled(true);
+                    glwidget->repaint();
+                }
+            }
+            unblanked(true, start);
+            unblank_timer.start();
+            return;
+        }
+        wakeUp();
         watch->keep_black = false;
         glwidget->update();
         if (!possiblyUnredirectTopmostWindow() && !compositing)
             enableCompositing();
-        /* start pinging again */
-        pingTopmost();
-        // restart damage tracking for redirected windows
-        for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-             it != windows.end(); ++it) {
-             MCompositeWindow *i = it.value();
-             MWindowPropertyCache *pc = i->propertyCache();
-             if (!i->isDirectRendered() && pc &&
-                 (pc->isMapped() || pc->beingMapped()))
-                 pc->damageTracking(true);
+        finishUnblank();
+        unblanked(false, start);
+    }
+}
+
+// While asleep, whether the lockscreen or a low-power mode window needs
+// the stacking to be looked at: if it's being mapped, if other windows
+// are above it, or if the low-power mode window is obscured.  Everything
+// else waits for the display.
+bool MCompositeManagerPrivate::sleepEssential() const
+{
+    bool covered = false;
+    for (int i = stacking_list.size() - 1; i >= 0; --i) {
+        MWindowPropertyCache *pc = prop_caches.value(stacking_list.at(i), 0);
+        if (!pc || !pc->is_valid || pc->isInputOnly())
+            continue;
+        if (!pc->isLockScreen() && !pc->lowPowerMode()) {
+            if (pc->isMapped() && !pc->isOverrideRedirect())
+                covered = true;
+            continue;
         }
+        if (pc->beingMapped())
+            return true;
+        if (!pc->isMapped())
+            continue;
+        MCompositeWindow *cw = COMPOSITE_WINDOW(pc->winId());
+        if (covered || !cw || (pc->lowPowerMode() && cw->windowObscured()))
+            return true;
+    }
+    return false;
+}
+
+// Returns whether the stacking check should wait for the display to come
+// on, in which case it's noted in @sleep_log.
+bool MCompositeManagerPrivate::deferWhileAsleep(bool force_visibility_check,
+                                                Time timestamp)
+{
+    if (!deep_sleep || sleepEssential())
+        return false;
+    sleep_log.stacking = true;
+    if (force_visibility_check)
+        sleep_log.visibility = true;
+    if (timestamp != CurrentTime)
+        sleep_log.timestamp = timestamp;
+    counters.sleep_deferred++;
+    return true;
+}
+
+// The property caches are up to date, react to the last change of each
+// property of @w noted while asleep.
+void MCompositeManagerPrivate::replayProperties(Window w,
+                               const QHash<Atom, SleepLog::Change> &changes)
+{
+    MWindowPropertyCache *pc = prop_caches.value(w, 0);
+    if (!pc || !pc->is_valid)
+        return;
+    QHash<Atom, SleepLog::Change>::const_iterator it;
+    for (it = changes.constBegin(); it != changes.constEnd(); ++it) {
+        XPropertyEvent e;
+        memset(&e, 0, sizeof(e));
+        e.type   = PropertyNotify;
+        e.window = w;
+        e.atom   = it.key();
+        e.state  = it.value().state;
+        e.time   = CurrentTime;
+        propertyChanged(&e, pc, it.value().affects_stacking);
+    }
+}
+
+// Leave the display-off power mode and catch up with what's been deferred.
+void MCompositeManagerPrivate::wakeUp()
+{
+    if (!deep_sleep)
+        return;
+    deep_sleep = false;
+    if (MXServerLatency *latency = MXServerLatency::instance())
+        latency->setSleeping(false);
+
+    SleepLog log = sleep_log;
+    sleep_log = SleepLog();
+
+    QHash<Window, QHash<Atom, SleepLog::Change> >::const_iterator it;
+    for (it = log.properties.constBegin();
+         it != log.properties.constEnd(); ++it)
+        replayProperties(it.key(), it.value());
+
+    // Have the stacking right for the first frame.
+    if (log.stacking || !log.properties.isEmpty())
+        checkStacking(log.visibility, log.timestamp);
+}
+
+// Whether the topmost windows are the lockscreen or low-power mode windows
+// which have been painted since mapping, so their textures are current.
+bool MCompositeManagerPrivate::unblankReady() const
+{
+    for (int i = stacking_list.size() - 1; i >= 0; --i) {
+        MWindowPropertyCache *pc = prop_caches.value(stacking_list.at(i), 0);
+        if (!pc || !pc->is_valid || !pc->isMapped() || pc->isInputOnly())
+            continue;
+        if (!pc->isLockScreen() && !pc->lowPowerMode())
+            return false;
+        MCompositeWindow *cw = COMPOSITE_WINDOW(pc->winId());
+        if (!cw || !cw->paintedAfterMapping() || pc->waitingForDamage())
+            return false;
+        if (!pc->isOverrideRedirect())
+            return true;
+    }
+    return false;
+}
+
+void MCompositeManagerPrivate::unblanked(bool fast, quint64 start_ns)
+{
+    const quint64 us = (now_ns() - start_ns) / 1000;
+    if (fast)
+        unblanks.fast++;
+    else
+        unblanks.slow++;
+    unblanks.last_us = us;
+    if (us > unblanks.max_us)
+        unblanks.max_us = us;
+}
+
+// The part of turning the display on which can wait for the first frame.
+void MCompositeManagerPrivate::finishUnblank()
+{
+    wakeUp();
+    /* start pinging again */
+    pingTopmost();
+    // restart damage tracking for redirected windows
+    for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
+         it != windows.end(); ++it) {
+         MCompositeWindow *i = it.value();
+         MWindowPropertyCache *pc = i->propertyCache();
+         if (!i->isDirectRendered() && pc &&
+             (pc->isMapped() || pc->beingMapped()))
+             pc->damageTracking(true);
     }
     dirtyStacking(true);  // VisibilityNotify generation
 }
@@ -2855,12 +3267,79 @@ void MCompositeManagerPrivate::setWindowState(Window w, int state, int level)
 
     if (pc && pc->isVirtual())
         return;
-    CARD32 d[2];
-    d[0] = state;
-    d[1] = None;
+    queueWindowState(w, state);
+}
+
+// Send a synthetic VisibilityNotify of @state to @w, unless it's been told
+// so already.  With @force it's sent even then.
+void MCompositeManagerPrivate::queueVisibility(Window w, int state, bool force)
+{
+    if (force)
+        sent_visibility.remove(w);
+    pending_visibility[w] = state;
+    if (!notify_timer.isActive())
+        notify_timer.start();
+}
+
+void MCompositeManagerPrivate::queueWindowState(Window w, int state)
+{
+    pending_wm_state[w] = state;
+    if (!notify_timer.isActive())
+        notify_timer.start();
+}
+
+// @w is gone, don't tell it anything more.
+void MCompositeManagerPrivate::forgetNotifications(Window w)
+{
+    pending_visibility.remove(w);
+    sent_visibility.remove(w);
+    pending_wm_state.remove(w);
+}
+
+// Send the notifications queued since the last time, at the end of
+// checkStacking() or of the event loop iteration, with a single flush.
+void MCompositeManagerPrivate::flushNotifications()
+{
+    Display *dpy = QX11Info::display();
+    QHash<Window, int>::const_iterator it;
+    bool sent = false;
+
+    notify_timer.stop();
+    for (it = pending_wm_state.constBegin();
+         it != pending_wm_state.constEnd(); ++it) {
+        // setWindowState() has checked it against the property, which
+        // the client may have changed since we last set it.
+        CARD32 d[2];
+        d[0] = it.value();
+        d[1] = None;
+        XChangeProperty(dpy, it.key(), ATOM(WM_STATE), ATOM(WM_STATE),
+                        32, PropModeReplace, (unsigned char *)d, 2);
+        counters.notifications++;
+        sent = true;
+    }
+    pending_wm_state.clear();
+
+    for (it = pending_visibility.constBegin();
+         it != pending_visibility.constEnd(); ++it) {
+        if (sent_visibility.value(it.key(), -1) == it.value()) {
+            counters.notifications_deduped++;
+            continue;
+        }
+        XVisibilityEvent c;
+        memset(&c, 0, sizeof(c));
+        c.type       = VisibilityNotify;
+        c.send_event = True;
+        c.window     = it.key();
+        c.state      = it.value();
+        XSendEvent(dpy, it.key(), true, VisibilityChangeMask, (XEvent *)&c);
+        sent_visibility[it.key()] = it.value();
+        counters.notifications++;
+        sent = true;
+    }
+    pending_visibility.clear();
 
-    XChangeProperty(QX11Info::display(), w, ATOM(WM_STATE), ATOM(WM_STATE),
-                    32, PropModeReplace, (unsigned char *)d, 2);
+    if (sent)
+        XFlush(dpy);
 }
 
 void MCompositeManager::setWindowState(Window w, int state)
@@ -2881,6 +3360,10 @@ void MCompositeManager::queryDialogAnswer(unsigned int window, bool yes_answer)
 
 bool MCompositeManagerPrivate::x11EventFilter(XEvent *event, bool startup)
 {
+    counters.x_events++;
+    if (recorder)
+        recorder->event(event);
+
     // Core non-subclassable events
     static const int damage_ev = damage_event + XDamageNotify;
     static int shape_event_base = 0;
@@ -2909,6 +3392,23 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event, bool startup)
         && processX11EventFilters(event, false))
         return true;
 
+    if (sync_event >= 0 && event->type == sync_event + XSyncAlarmNotify) {
+        XSyncAlarmNotifyEvent *e = (XSyncAlarmNotifyEvent *)event;
+        MCompositeWindow *cw;
+        if (e->state == XSyncAlarmDestroyed
+            || !(cw = COMPOSITE_WINDOW(sync_alarms.value(e->alarm))))
+            return true;
+        if (e->alarm == cw->frameAlarm()) {
+            const quint64 value =
+                (quint64(XSyncValueHigh32(e->counter_value)) << 32)
+                | XSyncValueLow32(e->counter_value);
+            if (!(value & 1))
+                frameDrawn(cw, value);
+        } else
+            cw->syncCompleted();
+        return true;
+    }
+
     if (event->type == damage_ev) {
         XDamageNotifyEvent *e = reinterpret_cast<XDamageNotifyEvent *>(event);
         damageEvent(e);
@@ -2984,19 +3484,87 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event, bool startup)
     return ret;
 }
 
+// The client has finished a frame of @cw.  If it won't be painted by us,
+// tell it right away, otherwise when the scene has been drawn.
+void MCompositeManagerPrivate::frameDrawn(MCompositeWindow *cw, quint64 value)
+{
+    if (cw->isDirectRendered() || !cw->isVisible()
+        || device_state->displayOff()) {
+        sendFrameDrawn(cw->window(), value);
+        frames_drawn.remove(cw->window());
+    } else {
+        frames_drawn[cw->window()] = value;
+        if (!pending_damage.contains(cw->window()))
+            // Make sure there will be a frame to report it after.
+            glwidget->update();
+    }
+}
+
+void MCompositeManagerPrivate::sendFrameDrawn(Window w, quint64 value)
+{
+    Display *dpy = QX11Info::display();
+    const quint64 now = now_ns() / 1000;
+    XEvent ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = w;
+    ev.xclient.message_type = ATOM(_NET_WM_FRAME_DRAWN);
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = value & 0xffffffff;
+    ev.xclient.data.l[1] = value >> 32;
+    ev.xclient.data.l[2] = now & 0xffffffff;
+    ev.xclient.data.l[3] = now >> 32;
+    XSendEvent(dpy, w, False, NoEventMask, &ev);
+
+    // We don't know when the frame hits the screen nor the refresh
+    // interval, which _NET_WM_FRAME_TIMINGS says with zeros.
+    ev.xclient.message_type = ATOM(_NET_WM_FRAME_TIMINGS);
+    ev.xclient.data.l[2] = 0;
+    ev.xclient.data.l[3] = 0;
+    ev.xclient.data.l[4] = 0;
+    XSendEvent(dpy, w, False, NoEventMask, &ev);
+}
+
+// Report the frames which made it into the scene just drawn.  Those whose
+// damage hasn't been repaired yet wait for the next one.
+void MCompositeManagerPrivate::reportFrames()
+{
+    QHash<Window, quint64>::iterator it = frames_drawn.begin();
+    while (it != frames_drawn.end()) {
+        if (pending_damage.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        if (windows.contains(it.key()))
+            sendFrameDrawn(it.key(), it.value());
+        it = frames_drawn.erase(it);
+    }
+}
+
 bool MCompositeManagerPrivate::processX11EventFilters(XEvent *event, bool after)
 {
-    if (!m_extensions.contains(event->type))
+    if (unsigned(event->type) >= MaxXEventType
+        || ext_dispatch[event->type].isEmpty())
         return false;
 
-    QList<MCompositeManagerExtension*> evlist = m_extensions.values(event->type);
+    // Shallow copy in case an extension starts listening to something.
+    const QVector<ExtensionHook> hooks = ext_dispatch[event->type];
     bool processed = false;
-    if (after)
-        for (int i = 0; i < evlist.size(); ++i)
-            evlist[i]->afterX11Event(event);
-    else
-        for (int i = 0; i < evlist.size(); ++i)
-            processed = evlist[i]->x11Event(event);
+    for (int i = 0; i < hooks.size(); ++i) {
+        const quint64 start = now_ns();
+        if (after)
+            hooks[i].ext->afterX11Event(event);
+        else
+            processed = hooks[i].ext->x11Event(event);
+
+        const quint64 took = now_ns() - start;
+        ExtensionTiming &timing = ext_timings[hooks[i].timing];
+        timing.calls++;
+        timing.total_ns += took;
+        if (took > timing.max_ns)
+            timing.max_ns = took;
+    }
 
     return processed;
 }
@@ -3074,6 +3642,7 @@ void MCompositeManagerPrivate::redirectWindows()
             }
         }
     }
+    adoptHandoff();
 
     // Wait for the MapNotify for the overlay (show() of the graphicsview
     // in main() causes it even if we don't map it explicitly)
@@ -3084,6 +3653,156 @@ void MCompositeManagerPrivate::redirectWindows()
         enableCompositing();
 }
 
+// Environment variable telling the restarted instance where the handoff is.
+#define HANDOFF_ENV "MCOMPOSITOR_HANDOFF_FD"
+static const quint32 HandoffVersion = 1;
+
+// Write the state adoptHandoff() needs into an unlinked file and return
+// its descriptor, which is inherited through exec(), or -1.
+int MCompositeManagerPrivate::saveHandoff() const
+{
+    FILE *tmp;
+    int fd;
+
+    if (!(tmp = tmpfile()) || (fd = dup(fileno(tmp))) < 0) {
+        qWarning("%s: couldn't create a temporary file", __func__);
+        if (tmp)
+            fclose(tmp);
+        return -1;
+    }
+    fclose(tmp);
+
+    QFile file;
+    if (!file.open(fd, QIODevice::WriteOnly)) {
+        ::close(fd);
+        return -1;
+    }
+    QDataStream out(&file);
+    out << HandoffVersion;
+
+    // The order of the windows is what we've decided, it may be
+    // different from the server's.
+    out << quint32(stacking_list.size());
+    foreach (Window w, stacking_list)
+        out << quint32(w);
+
+    QList<Window> hung;
+    foreach (MCompositeWindow *cw, windows)
+        if (cw->isHung())
+            hung.append(cw->window());
+    out << quint32(hung.size());
+    foreach (Window w, hung)
+        out << quint32(w);
+
+    // The timers can't be carried over.  Those which haven't started
+    // blocking will do when their window is mapped, the rest block
+    // for the full time again.  Those which don't block anymore would
+    // be dropped anyway.
+    QList<unsigned> blocking, waiting;
+    QHash<unsigned, DismissedSplash>::const_iterator it;
+    for (it = dismissedSplashScreens.constBegin();
+         it != dismissedSplashScreens.constEnd(); ++it)
+        if (!it->blockTimer.isValid())
+            waiting.append(it.key());
+        else if (it->blockTimer.elapsed() < DismissedSplash::BLOCK_DURATION)
+            blocking.append(it.key());
+    out << quint32(waiting.size());
+    foreach (unsigned pid, waiting)
+        out << quint32(pid);
+    out << quint32(blocking.size());
+    foreach (unsigned pid, blocking)
+        out << quint32(pid);
+    out << quint32(lastDestroyedSplash.window)
+        << quint32(lastDestroyedSplash.pid);
+
+    if (out.status() != QDataStream::Ok || !file.flush()) {
+        qWarning("%s: couldn't write the handoff", __func__);
+        ::close(fd);
+        return -1;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// Take over the state saved by the previous instance's saveHandoff(),
+// after the existing windows have been added.
+void MCompositeManagerPrivate::adoptHandoff()
+{
+    const char *env = getenv(HANDOFF_ENV);
+    if (!env)
+        return;
+    char *end;
+    long fd = strtol(env, &end, 10);
+    unsetenv(HANDOFF_ENV);
+
+    // Don't read or close() whatever we've been given, only the kind
+    // of file saveHandoff() makes.
+    struct stat st;
+    if (*end || fd <= 2 || fd > INT_MAX
+        || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        qWarning("%s: ignoring invalid %s", __func__, HANDOFF_ENV);
+        return;
+    }
+
+    QFile file;
+    if (!file.open(fd, QIODevice::ReadOnly)) {
+        ::close(fd);
+        return;
+    }
+    QDataStream in(&file);
+    quint32 version, n, w, pid;
+
+    in >> version;
+    if (version != HandoffVersion) {
+        qWarning("%s: handoff version %u is not supported", __func__,
+                 version);
+        ::close(fd);
+        return;
+    }
+
+    // Put the windows we know in the previous order, keeping the places
+    // of the new ones.
+    QList<Window> order;
+    in >> n;
+    while (n-- > 0 && in.status() == QDataStream::Ok) {
+        in >> w;
+        if (stacking_list.contains(w))
+            order.append(w);
+    }
+    const QSet<Window> known = order.toSet();
+    for (int i = 0, j = 0; i < stacking_list.size(); ++i)
+        if (known.contains(stacking_list[i]))
+            stacking_list[i] = order[j++];
+
+    in >> n;
+    while (n-- > 0 && in.status() == QDataStream::Ok) {
+        in >> w;
+        MCompositeWindow *cw = COMPOSITE_WINDOW(w);
+        if (cw && cw->propertyCache() && cw->propertyCache()->isMapped()) {
+            cw->hangIt();
+            gotHungWindow(cw, true);
+        }
+    }
+
+    in >> n;
+    while (n-- > 0 && in.status() == QDataStream::Ok) {
+        in >> pid;
+        dismissedSplashScreens[pid];
+    }
+    in >> n;
+    while (n-- > 0 && in.status() == QDataStream::Ok) {
+        in >> pid;
+        dismissedSplashScreens[pid].blockTimer.start();
+    }
+    in >> w >> pid;
+    lastDestroyedSplash = DestroyedSplash(w, pid);
+
+    if (in.status() != QDataStream::Ok)
+        qWarning("%s: truncated handoff", __func__);
+    ::close(fd);
+    dirtyStacking(false);
+}
+
 void MCompositeManagerPrivate::removeWindow(Window w)
 {
     // Item is already removed from scene when it is deleted
@@ -3445,6 +4164,7 @@ MCompositeWindow *MCompositeManagerPrivate::bindWindow(Window window,
     MWindowPropertyCache *pc = item->propertyCache();
 
     windows[window] = item;
+    item->watchFrames();
 
     const XWMHints &h = pc->getWMHints();
     if (pc->stackedUnmapped()) {
@@ -3676,6 +4396,12 @@ void MCompositeManagerPrivate::positionWindow(Window w, bool on_top)
     dirtyStacking(false);
 }
 
+void MCompositeManager::framePainted()
+{
+    if (!d->frames_drawn.isEmpty())
+        d->reportFrames();
+}
+
 void MCompositeManager::expectResize(MCompositeWindow *cw, const QRect &r)
 {
     XConfigureEvent xev;
@@ -3717,10 +4443,15 @@ const QList<Window> &MCompositeManager::stackingList() const
 
 void MCompositeManagerPrivate::enableCompositing()
 {
+    const quint64 start = now_ns();
+    const bool was_compositing = compositing;
+
     if (!overlay_mapped)
         showOverlayWindow(true);
     else
         enableRedirection();
+    if (!was_compositing)
+        switched(true, start);
 }
 
 void MCompositeManagerPrivate::showOverlayWindow(bool show)
@@ -3867,6 +4598,25 @@ void MCompositeManagerPrivate::installX11EventFilter(long xevent,
                                                      MCompositeManagerExtension* extension)
 {
     m_extensions.insert(xevent, extension);
+    if (xevent < 0 || xevent >= MaxXEventType) {
+        qWarning("%s: invalid event type %ld", __func__, xevent);
+        return;
+    }
+
+    int timing;
+    for (timing = 0; timing < ext_timings.size(); ++timing)
+        if (ext_timings[timing].ext == extension)
+            break;
+    if (timing == ext_timings.size()) {
+        ext_timings.append(ExtensionTiming());
+        ext_timings.last().ext = extension;
+    }
+
+    // The last installed one is called first, as it used to be.
+    ExtensionHook hook;
+    hook.ext = extension;
+    hook.timing = timing;
+    ext_dispatch[xevent].prepend(hook);
 }
 
 void MCompositeManager::sighupHandler(int signo)
@@ -3950,6 +4700,25 @@ void MCompositeManager::dumpState(const char *heading)
                d->stacking_timer.isActive() ? "active" : "idle");
     qDebug(    "check_visibility: %s",
                tf[d->stacking_timeout_check_visibility]);
+    qDebug(    "pending damage:   %d windows", d->pending_damage.size());
+    qDebug(    "window timers:    %d active", MTimerWheel::instance()->count());
+    if (MXServerLatency *latency = MXServerLatency::instance())
+        qDebug("X round-trip:     %s", latency->toString().toLatin1().constData());
+    const MSGrabber::Stats &grabs = servergrab.stats();
+    qDebug(    "%s:      %u, %lld ms in total, %lld ms at most",
+               servergrab.grabFree() ? "freezes" : "grabs ", grabs.grabs,
+               grabs.total_ms, grabs.max_ms);
+    qDebug(    "switches:         %u to compositing, %u to direct, %u held, "
+               "%lld us in total, %lld us at most",
+               d->switches.to_composited, d->switches.to_direct,
+               d->switches.held, (long long)d->switches.total_us,
+               (long long)d->switches.max_us);
+    qDebug(    "unblanks:         %u fast, %u slow, %lld us last, "
+               "%lld us at most", d->unblanks.fast, d->unblanks.slow,
+               (long long)d->unblanks.last_us, (long long)d->unblanks.max_us);
+    qDebug(    "deep sleep:       %s, %d windows' properties%s deferred",
+               tf[d->deep_sleep], d->sleep_log.properties.size(),
+               d->sleep_log.stacking ? " and stacking" : "");
 
     // Top windows per stacking layer.
     qDebug("stacking layers:");
@@ -4129,10 +4898,190 @@ void MCompositeManager::dumpState(const char *heading)
         qDebug("-- %s for event(s) %s:",
                exit.key()->metaObject()->className(),
                events.toLatin1().constData());
+        foreach (const MCompositeManagerPrivate::ExtensionTiming &timing,
+                 d->ext_timings)
+            if (timing.ext == exit.key())
+                qDebug("   %llu calls in %llu us, %llu us at most",
+                       timing.calls, timing.total_ns / 1000,
+                       timing.max_ns / 1000);
         exit.key()->dumpState();
     }
 }
 
+template<class T>
+static void dumpWindowsJson(MJsonWriter &json, const char *key, const T &wins,
+                            bool leftToRight = true)
+{
+    int nwins = wins.count();
+    json.beginArray(key);
+    for (int i = 0; i < nwins; i++)
+        json.number(0, wins[leftToRight ? i : nwins-1-i]);
+    json.endArray();
+}
+
+// The name of @value or the number if it's not in @e, eg. the state of
+// a window whose WM_STATE has been deleted.
+static void dumpEnum(MJsonWriter &json, const char *key, const QMetaEnum &e,
+                     int value)
+{
+    const char *name = e.valueToKey(value);
+    if (name)
+        json.string(key, name);
+    else
+        json.number(key, value);
+}
+
+void MCompositeManager::dumpStateJson(QIODevice *out)
+{
+    const QMetaObject mca = MCompAtoms::staticMetaObject;
+    const QMetaEnum wintypes =
+        mca.enumerator(mca.indexOfEnumerator("Type"));
+    const QMetaObject mpc = MWindowPropertyCache::staticMetaObject;
+    const QMetaEnum winstates =
+        mpc.enumerator(mpc.indexOfEnumerator("WindowState"));
+    const QMetaObject mcw = MCompositeWindow::staticMetaObject;
+    const QMetaEnum appstates =
+        mcw.enumerator(mcw.indexOfEnumerator("WindowStatus"));
+    MJsonWriter json(out);
+    MCompositeWindow *cw;
+    int i;
+
+    json.beginObject();
+    json.number("time", QDateTime::currentDateTime().toTime_t());
+    json.boolean("display_on", !d->device_state->displayOff());
+    json.boolean("call_ongoing", d->device_state->ongoingCall());
+    json.boolean("compositing", isCompositing());
+    json.boolean("overlay_mapped", d->overlay_mapped);
+    json.number("current_app", d->current_app);
+    json.number("topmost_app", d->getTopmostApp(&i));
+    json.number("highest_decorated",
+                (cw = d->getHighestDecorated()) != NULL ? cw->window() : 0);
+    json.number("decorated_window",
+                MDecoratorFrame::instance()->managedWindow());
+    json.number("desktop", d->desktop_window);
+
+    json.beginObject("timers");
+    json.boolean("stacking", d->stacking_timer.isActive());
+    json.boolean("damage", d->damage_timer.isActive());
+    json.number("window_timers", MTimerWheel::instance()->count());
+    json.endObject();
+
+    json.beginObject("counters");
+    json.number("x_events", d->counters.x_events);
+    json.number("damage_events", d->counters.damage_events);
+    json.number("repairs", d->counters.repairs);
+    json.number("stacking_checks", d->counters.stacking_checks);
+    json.number("notifications", d->counters.notifications);
+    json.number("notifications_deduped", d->counters.notifications_deduped);
+    json.number("sleep_deferred", d->counters.sleep_deferred);
+    json.number("pending_damage", d->pending_damage.size());
+    json.endObject();
+
+    json.beginObject("switches");
+    json.number("to_compositing", d->switches.to_composited);
+    json.number("to_direct", d->switches.to_direct);
+    json.number("held", d->switches.held);
+    json.number("hold_ms", d->holdTime());
+    json.number("total_us", d->switches.total_us);
+    json.number("max_us", d->switches.max_us);
+    json.endObject();
+
+    json.beginObject("unblank");
+    json.number("fast", d->unblanks.fast);
+    json.number("slow", d->unblanks.slow);
+    json.number("last_us", d->unblanks.last_us);
+    json.number("max_us", d->unblanks.max_us);
+    json.endObject();
+
+    json.beginObject("deep_sleep");
+    json.boolean("active", d->deep_sleep);
+    json.number("deferred_windows", d->sleep_log.properties.size());
+    json.boolean("deferred_stacking", d->sleep_log.stacking);
+    json.endObject();
+
+    json.beginObject("server_grab");
+    json.boolean("grab_free", servergrab.grabFree());
+    json.number("grabs", servergrab.stats().grabs);
+    json.number("total_ms", servergrab.stats().total_ms);
+    json.number("max_ms", servergrab.stats().max_ms);
+    json.endObject();
+
+    if (MXServerLatency *latency = MXServerLatency::instance()) {
+        MXServerLatency::Stats st;
+        const bool available = latency->stats(st);
+        json.beginObject("x_round_trip_us");
+        json.boolean("available", available);
+        if (available) {
+            json.number("samples", st.samples);
+            json.number("p50", st.p50);
+            json.number("p90", st.p90);
+            json.number("p99", st.p99);
+            json.number("max", st.max);
+            json.number("stalls", st.stalls);
+        }
+        json.endObject();
+    }
+
+    json.beginArray("extensions");
+    foreach (const MCompositeManagerPrivate::ExtensionTiming &timing,
+             d->ext_timings) {
+        json.beginObject();
+        json.string("class", timing.ext->metaObject()->className());
+        json.number("calls", timing.calls);
+        json.number("total_us", timing.total_ns / 1000);
+        json.number("max_us", timing.max_ns / 1000);
+        json.endObject();
+    }
+    json.endArray();
+
+    // Top to bottom like in dumpState().
+    dumpWindowsJson(json, "stacking_list", d->stacking_list, false);
+    dumpWindowsJson(json, "mapping_order", d->netClientList, false);
+
+    json.beginArray("windows");
+    QHash<Window, MCompositeWindow *>::const_iterator cwit;
+    for (cwit = d->windows.constBegin(); cwit != d->windows.constEnd();
+         ++cwit) {
+        MCompositeWindow *behind;
+        MCompositeWindow *cw = *cwit;
+        MWindowPropertyCache *pc = cw->propertyCache();
+
+        json.beginObject();
+        json.number("window", cw->window());
+        json.boolean("valid", cw->isValid());
+        json.number("pid", pc->pid());
+        json.string("name", pc->wmName());
+        dumpEnum(json, "type", wintypes, pc->windowType());
+        dumpEnum(json, "status", appstates, cw->status());
+        dumpEnum(json, "state", winstates, pc->windowState());
+        json.rect("geometry", pc->realGeometry());
+        json.boolean("mapped", cw->isMapped());
+        json.boolean("newly_mapped", cw->isNewlyMapped());
+        json.boolean("stacked_unmapped", pc->stackedUnmapped());
+        json.boolean("input_only", pc->isInputOnly());
+        json.boolean("visible", cw->isVisible());
+        json.boolean("obscured", cw->windowObscured());
+        json.boolean("direct_rendered", cw->isDirectRendered());
+        json.boolean("app", cw->isAppWindow());
+        json.boolean("needs_decoration", cw->needDecoration());
+        json.real("opacity", cw->opacity());
+        json.number("pixmap", cw->windowPixmap());
+        json.boolean("animating", cw->windowAnimator()
+                                  && cw->windowAnimator()->isActive());
+        json.boolean("transitioning", cw->isWindowTransitioning());
+        json.boolean("has_transitioning", cw->hasTransitioningWindow());
+        json.boolean("closing", cw->isClosing());
+        json.number("stack_index", cw->indexInStack());
+        json.number("behind", (behind = cw->behind()) ? behind->window() : 0);
+        json.number("last_visible_parent", cw->lastVisibleParent());
+        dumpWindowsJson(json, "transients", pc->transientWindows());
+        json.endObject();
+    }
+    json.endArray();
+
+    json.endObject();
+}
+
 void MCompositeManager::xtrace(const char *fun, const char *msg, int lmsg)
 {
     MCompositeManager *p = static_cast<MCompositeManager *>(qApp);
@@ -4205,6 +5154,76 @@ void MCompositeManager::remoteControl(int cmdfd)
     } else if (!strncmp(cmd, "state ", strlen("state "))) {
         const char *space = &cmd[strlen("state")];
         dumpState(space+strspn(space, " "));
+    } else if (!strcmp(cmd, "json")
+               || !strncmp(cmd, "json ", strlen("json "))) {
+        // dumpStateJson() into a regular file.  The dump is written
+        // synchronously, so FIFOs and devices are refused lest we block
+        // waiting for a reader.
+        static unsigned cnt = 0;
+        int pos;
+        QString fname;
+        const char *cfname;
+        QRegExp rex("%(\\.\\d+)?[diuxX]");
+
+        if ((cfname = strchr(cmd, ' ')) != NULL)
+            cfname += strspn(cfname, " ");
+        fname = cfname && *cfname ? cfname : "mc.json.%.2u";
+        if ((pos = rex.indexIn(fname)) >= 0)
+            fname.replace(pos, rex.cap(0).length(),
+                          QString().sprintf(rex.cap(0).toLatin1().constData(),
+                                            cnt++));
+
+        // O_NONBLOCK makes opening a FIFO fail or return at once.
+        struct stat st;
+        int fd = open(fname.toLocal8Bit().constData(),
+                      O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
+        if (fd < 0) {
+            qDebug("couldn't open %s", fname.toLatin1().constData());
+            return;
+        }
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            qDebug("%s: not a regular file", fname.toLatin1().constData());
+            ::close(fd);
+            return;
+        }
+        if (ftruncate(fd, 0) < 0)
+            qWarning("couldn't truncate %s", fname.toLatin1().constData());
+
+        QFile out;
+        if (out.open(fd, QIODevice::WriteOnly)) {
+            dumpStateJson(&out);
+            out.close();
+            qDebug("state dumped into %s", fname.toLatin1().constData());
+        } else
+            qDebug("couldn't open %s", fname.toLatin1().constData());
+        ::close(fd);
+    } else if (!strcmp(cmd, "record")
+               || !strncmp(cmd, "record ", strlen("record "))) {
+        // Start or stop recording the X events for tests/replay.
+        const char *cfname;
+        int shape_event, shape_error;
+
+        delete d->recorder;
+        d->recorder = 0;
+        if ((cfname = strchr(cmd, ' ')) != NULL)
+            cfname += strspn(cfname, " ");
+        if (!cfname || !*cfname) {
+            qDebug("stopped recording");
+            return;
+        }
+
+        if (!XShapeQueryExtension(QX11Info::display(), &shape_event,
+                                  &shape_error))
+            shape_event = 0;
+        d->recorder = new MEventRecorder(cfname,
+                                         d->damage_event + XDamageNotify,
+                                         shape_event + ShapeNotify);
+        if (d->recorder->isOpen()) {
+            qDebug("recording into %s", cfname);
+        } else {
+            delete d->recorder;
+            d->recorder = 0;
+        }
     } else if (!strcmp(cmd, "save")
                || !strncmp(cmd, "save ", strlen("save "))) {
         // dumpState() into a file
@@ -4286,7 +5305,15 @@ void MCompositeManager::remoteControl(int cmdfd)
         QStringList args = qApp->arguments();
         const char **argv;
         unsigned i;
-
+        int handoff;
+
+        // Keep the bookkeeping across exec().
+        d->flushNotifications();
+        if ((handoff = d->saveHandoff()) >= 0)
+            setenv(HANDOFF_ENV, QByteArray::number(handoff).constData(), 1);
+        // The screen stays black until the new instance has painted:
+        // the overlay window and the GL context die with us and can't
+        // be carried over exec().
         delete d;
 #ifdef GLES2_VERSION
         eglTerminate(eglGetDisplay(EGLNativeDisplayType(EGL_DEFAULT_DISPLAY)));
@@ -4322,12 +5349,15 @@ void MCompositeManager::remoteControl(int cmdfd)
         qDebug("  state [<tag>]   dump MCompositeManager, MCompositeWindow:s ");
         qDebug("                  and QGraphicsScene state information");
         qDebug("  save [<fname>]  dump it into <fname>");
+        qDebug("  json [<fname>]  dump it and some counters as JSON");
+        qDebug("  record [<fname>] record the X events for mcreplay into <fname>,");
+        qDebug("                  or stop recording");
         qDebug("  hang            take it as if the topmost application hung");
         qDebug("  unhang          take it as if the hung application ponged");
         qDebug("  say <something> log <something>");
         qDebug("  debug, nodebug  turn the SIGUSR1 debug mode on/off");
         qDebug("  exit, quit      geez");
-        qDebug("  restart         re-execute mcompositor");
+        qDebug("  restart         re-execute mcompositor, keeping the state");
         qDebug("  reload          reload the settings");
     } else {
         qDebug("%s: unknown command", cmd);
@@ -4335,12 +5365,15 @@ void MCompositeManager::remoteControl(int cmdfd)
 }
 
 MCompositeManager::MCompositeManager(int &argc, char **argv)
-    : QApplication(argc, argv)
+    : QApplication(argc, argv), d(0), config_loaded(false)
 {
+    config_timer.setSingleShot(true);
+    connect(&config_timer, SIGNAL(timeout()), SIGNAL(configChanged()));
     ensureSettingsFile();
 
     d = new MCompositeManagerPrivate(this);
     connect(d, SIGNAL(windowBound(MCompositeWindow*)), SIGNAL(windowBound(MCompositeWindow*)));
+    connect(this, SIGNAL(configChanged()), d, SLOT(applyConfig()));
     connect(d->device_state, SIGNAL(incomingCall()),
             &servergrab, SLOT(ungrab()));
 
@@ -4508,6 +5541,11 @@ void MCompositeManager::config(char const *ckey, QVariant const &val) const
 {
     QLatin1String key(ckey);
     default_settings[key] = val;
+    // Changing a default at runtime, eg. from a test.  Only the affected
+    // setting is reloaded, and the change is announced once the caller
+    // is done changing them.
+    if (config_loaded && !settings->contains(key) && loadConfig(ckey))
+        config_timer.start();
 }
 
 QVariant MCompositeManager::config(char const *ckey) const
@@ -4542,6 +5580,62 @@ void MCompositeManager::reloadConfig()
     else if (settings->status() == QSettings::FormatError)
         qDebug() << __func__ << "config file" << settings->fileName()
                  << "is in invalid format";
+    loadConfig();
+}
+
+// Take a snapshot of the settings into @current_config.
+void MCompositeManager::loadConfig()
+{
+    loadConfig(0);
+    config_loaded = true;
+    config_timer.stop();
+    emit configChanged();
+}
+
+// Reload the setting of @key into @current_config, or all of them if
+// it's NULL.  Returns whether @key is in there.
+bool MCompositeManager::loadConfig(const char *key) const
+{
+    Config &c = current_config;
+    bool found = false;
+
+#define LOAD(field, name, value)                                \
+    if (!key || !strcmp(key, name)) {                           \
+        c.field = value;                                        \
+        found = true;                                           \
+    }
+#define LOAD_INT(field, name)  LOAD(field, name, configInt(name))
+#define LOAD_BOOL(field, name) LOAD(field, name, configInt(name) != 0)
+
+    LOAD_INT(startup_anim_duration, "startup-anim-duration")
+    LOAD_INT(crossfade_duration, "crossfade-duration")
+    LOAD(switcher_keysym, "switcher-keysym",
+         config("switcher-keysym").toString())
+    LOAD_INT(ping_interval_ms, "ping-interval-ms")
+    LOAD_INT(hung_dialog_reappear_ms, "hung-dialog-reappear-ms")
+    LOAD_INT(damages_for_starting_anim, "damages-for-starting-anim")
+    LOAD_INT(damage_timeout_ms, "damage-timeout-ms")
+    LOAD_INT(expect_resize_timeout_ms, "expect-resize-timeout-ms")
+    LOAD_INT(splash_timeout_ms, "splash-timeout-ms")
+    LOAD_INT(lockscreen_map_timeout_ms, "lockscreen-map-timeout-ms")
+    LOAD_INT(default_statusbar_height, "default-statusbar-height")
+    LOAD_INT(default_desktop_angle, "default-desktop-angle")
+    LOAD_INT(close_timeout_ms, "close-timeout-ms")
+    LOAD_INT(sheet_anim_duration, "sheet-anim-duration")
+    LOAD_INT(chained_anim_duration, "chained-anim-duration")
+    LOAD_INT(callui_anim_duration, "callui-anim-duration")
+    LOAD_INT(ungrab_grab_delay, "ungrab-grab-delay")
+    LOAD_BOOL(shader_binary_cache, "shader-binary-cache")
+    LOAD_BOOL(server_grab, "server-grab")
+    LOAD_INT(unredirect_delay, "unredirect-delay")
+    LOAD_INT(unredirect_max_delay, "unredirect-max-delay")
+    LOAD_BOOL(deep_sleep, "deep-sleep")
+    LOAD_BOOL(instant_unblank, "instant-unblank")
+
+#undef LOAD_BOOL
+#undef LOAD_INT
+#undef LOAD
+    return found;
 }
 
 void MCompositeManager::recheckVisibility() const
@@ -4592,6 +5686,13 @@ void MCompositeManager::ensureSettingsFile()
     config("chained-anim-duration",             500);
     config("callui-anim-duration",              400);
     config("ungrab-grab-delay",                 150);
+    config("shader-binary-cache",                 1);
+    config("server-grab",                         1);
+    config("unredirect-delay",                  100);
+    config("unredirect-max-delay",             1000);
+    config("deep-sleep",                          1);
+    config("instant-unblank",                     1);
+    loadConfig();
 }
 
 bool MCompositeManager::ignoreThisWindow(Window w) const
@@ -4659,7 +5760,7 @@ MSGrabber::MSGrabber()
     connect(&delayedGrabTimer, SIGNAL(timeout()), this, SLOT(commit()));
     delayedGrabTimer.setSingleShot(true);
     timeSinceLastUngrab.invalidate();
-    has_grab = needs_grab = false;
+    has_grab = needs_grab = server_grabbed = false;
 }
 
 void MSGrabber::grab()
@@ -4674,12 +5775,37 @@ void MSGrabber::ungrab()
     commit();
 }
 
+bool MSGrabber::grabFree() const
+{
+    MCompositeManager *cm = (MCompositeManager*)qApp;
+    return !cm->cfg().server_grab;
+}
+
+// Show the windows being painted from a copy of their current contents,
+// or their live contents again.
+void MSGrabber::freezeContents(bool freeze)
+{
+    MCompositeManager *cm = (MCompositeManager*)qApp;
+    foreach (MCompositeWindow *cw, cm->d->windows) {
+        MTexturePixmapItem *item = qobject_cast<MTexturePixmapItem *>(cw);
+        if (!item)
+            continue;
+        if (!freeze)
+            item->thawContents();
+        else if (!item->isDirectRendered()
+                 && (item->propertyCache()->isMapped()
+                     || item->isWindowTransitioning()))
+            item->freezeContents();
+    }
+}
+
 bool MSGrabber::grabDelayIsActive() const
 {
-    if (!timeSinceLastUngrab.isValid())
-        return false;
     MCompositeManager *cm = (MCompositeManager*)qApp;
-    const int ungrabGrabDelay = cm->configInt("ungrab-grab-delay");
+    if (!timeSinceLastUngrab.isValid() || grabFree())
+        // Freezing doesn't stop the others, no need to let them catch up.
+        return false;
+    const int ungrabGrabDelay = cm->cfg().ungrab_grab_delay;
     const qint64 msSinceLastUngrab = timeSinceLastUngrab.elapsed();
     return msSinceLastUngrab < ungrabGrabDelay;
 }
@@ -4699,7 +5825,7 @@ void MSGrabber::commit()
     MCompositeManager *cm = (MCompositeManager*)qApp;
     if (needs_grab && grabDelayIsActive()) {
         if (!delayedGrabTimer.isActive()) {
-            delayedGrabTimer.start(cm->configInt("ungrab-grab-delay")
+            delayedGrabTimer.start(cm->cfg().ungrab_grab_delay
                                    - timeSinceLastUngrab.elapsed());
         }
         // start mercytimer to change needs_grab to false in case there
@@ -4710,18 +5836,36 @@ void MSGrabber::commit()
 
     if (needs_grab) {
         Q_ASSERT(!has_grab && !mercytimer.isActive());
-        XGrabServer(QX11Info::display());
+        if ((server_grabbed = !grabFree()))
+            XGrabServer(QX11Info::display());
+        else
+            freezeContents(true);
         // reset global alpha
         cm->recheckVisibility();
         mercytimer.start();
+        holdTime.start();
+        has_grab = true;
     } else {
         Q_ASSERT(has_grab && mercytimer.isActive());
-        XUngrabServer(QX11Info::display());
+        if (server_grabbed)
+            XUngrabServer(QX11Info::display());
         mercytimer.stop();
         timeSinceLastUngrab.start();
+        has_grab = server_grabbed = false;
+
+        const qint64 held = holdTime.elapsed();
+        grab_stats.grabs++;
+        grab_stats.total_ms += held;
+        if (held > grab_stats.max_ms)
+            grab_stats.max_ms = held;
+
+        // Catch up with what the clients have drawn meanwhile.
+        freezeContents(false);
+        foreach (Window w, deferred_damage)
+            if (MCompositeWindow *cw = COMPOSITE_WINDOW(w))
+                cw->updateWindowPixmap();
+        deferred_damage.clear();
     }
-
-    has_grab = needs_grab;
 }
 
 // Tells Miss Grabber that you still need the grab, and restarts @mercytimer.
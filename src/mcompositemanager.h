@@ -27,6 +27,7 @@
 #include <QTimer>
 #include <mwindowpropertycache.h>
 #include <QElapsedTimer>
+#include <QSet>
 
 class QGraphicsScene;
 class MCompositeManagerPrivate;
@@ -54,6 +55,23 @@ public:
     bool hasGrab() const { return has_grab; }
     bool grabDelayIsActive() const;
 
+    // With the "server-grab" setting off grab() doesn't grab the server
+    // but freezes the contents of the windows shown until the ungrab(),
+    // so the other clients can go on.  The windows are painted from a
+    // copy of their pixmaps taken at grab(), and the damage of @w received
+    // meanwhile is to be deferDamage()d.
+    bool grabFree() const;
+    bool contentsFrozen() const { return has_grab && !server_grabbed; }
+    void deferDamage(Window w) { deferred_damage.insert(w); }
+
+    // How long we've been holding the grab (or freeze).
+    struct Stats {
+        Stats() : grabs(0), total_ms(0), max_ms(0) { }
+        unsigned grabs;
+        qint64 total_ms, max_ms;
+    };
+    const Stats &stats() const { return grab_stats; }
+
 public slots:
     void commit();
 
@@ -69,6 +87,12 @@ private:
     // @needs_grab tells whether commit() should grab or ungrab.
     // After commit() these state variables should be equal.
     bool needs_grab, has_grab;
+    // Whether @has_grab is a real server grab.
+    bool server_grabbed;
+    QSet<Window> deferred_damage;
+    QElapsedTimer holdTime;
+    Stats grab_stats;
+    void freezeContents(bool freeze);
 
     friend class ut_Anim;
 };
@@ -195,6 +219,12 @@ public:
     QHash<Window, MWindowPropertyCache*>& propCaches() const;
 
     void expectResize(MCompositeWindow *cw, const QRect &r);
+
+    /*!
+     * Called by MCompositeScene when it has drawn a frame.
+     */
+    void framePainted();
+
     enum StackPosition {
         STACK_BOTTOM = 0,
         STACK_TOP
@@ -216,6 +246,36 @@ public:
     QVariant config(const char *key) const;
     void config(const char *key, const QVariant &val) const;
     void reloadConfig();
+
+    // The settings we use, read from the config file or defaulted when
+    // it's (re)loaded.  Use these rather than config*() on the hot paths,
+    // which look them up in QSettings every time.
+    struct Config {
+        int startup_anim_duration;
+        int crossfade_duration;
+        QString switcher_keysym;
+        int ping_interval_ms;
+        int hung_dialog_reappear_ms;
+        int damages_for_starting_anim;
+        int damage_timeout_ms;
+        int expect_resize_timeout_ms;
+        int splash_timeout_ms;
+        int lockscreen_map_timeout_ms;
+        int default_statusbar_height;
+        int default_desktop_angle;
+        int close_timeout_ms;
+        int sheet_anim_duration;
+        int chained_anim_duration;
+        int callui_anim_duration;
+        int ungrab_grab_delay;
+        bool shader_binary_cache;
+        bool server_grab;
+        int unredirect_delay;
+        int unredirect_max_delay;
+        bool deep_sleep;
+        bool instant_unblank;
+    };
+    const Config &cfg() const { return current_config; }
     void recheckVisibility() const;
     void checkStacking(bool force_visibility_check,
                        Time timestamp = CurrentTime);
@@ -246,6 +306,11 @@ public:
     // (-DWINDOW_DEBUG).
     void dumpState(const char *heading = 0);
 
+    // Write the same as dumpState() and some counters to @out as JSON,
+    // for the tools.  Unlike dumpState() it doesn't ask anything from
+    // X or /proc.
+    void dumpStateJson(QIODevice *out);
+
     // "Print" @msg in xtrace, to show you where your program's control was
     // between the various X requests, responses and events.
     // Synopsis:
@@ -293,14 +358,27 @@ public slots:
      */
     void windowBound(MCompositeWindow* window);
 
+    /*!
+     * Emitted when cfg() has changed, for those who copied something
+     * from it.
+     */
+    void configChanged();
+
 private slots:
     void handleSigHup();
 
 private:
     void ensureSettingsFile();
+    void loadConfig();
+    bool loadConfig(const char *key) const;
     static void sighupHandler(int signo);
     MCompositeManagerPrivate *d;
     QSettings *settings;
+    // Mutable for config(key, value).
+    mutable Config current_config;
+    bool config_loaded;
+    // Coalesces the configChanged()s of changing defaults at runtime.
+    mutable QTimer config_timer;
     static int sighupFd[2];
 
     friend class MCompositeWindow;
@@ -310,6 +388,7 @@ private:
     friend class MWindowPropertyCache;
     friend class MCompositeWindowGroup;
     friend class MSplashScreen;
+    friend class MSGrabber;
     friend class ut_Stacking;
     friend class ut_Anim;
     friend class ut_Lockscreen;
@@ -50,6 +50,7 @@ class MDeviceState;
 class MWindowPropertyCache;
 class MCompositeManagerExtension;
 class MSplashScreen;
+class MEventRecorder;
 
 /*!
  * Internal implementation of MCompositeManager
@@ -85,9 +86,12 @@ public:
     void positionWindow(Window w, bool on_top);
     void addItem(MCompositeWindow *item);
     void damageEvent(XDamageNotifyEvent *);
+    void repairDamage(MCompositeWindow *item, Time t);
     void createEvent(XCreateWindowEvent *);
     void destroyEvent(XDestroyWindowEvent *);
     void propertyEvent(XPropertyEvent *);
+    void propertyChanged(XPropertyEvent *e, MWindowPropertyCache *pc,
+                         bool affects_stacking);
     void unmapEvent(XUnmapEvent *);
     void configureEvent(XConfigureEvent *, bool nostacking = false);
     void configureRequestEvent(XConfigureRequestEvent *);
@@ -97,6 +101,11 @@ public:
     void clientMessageEvent(XClientMessageEvent *);
     void keyEvent(XKeyEvent*);
     void installX11EventFilter(long xevent, MCompositeManagerExtension* extension);
+
+    // For the "restart" command: pass what can't be found out from X
+    // to the next instance.
+    int saveHandoff() const;
+    void adoptHandoff();
     
     void redirectWindows();
     void showOverlayWindow(bool show);
@@ -117,6 +126,7 @@ public:
     bool hasTransientVKB(MWindowPropertyCache *pc) const;
 
     bool possiblyUnredirectTopmostWindow();
+    bool isBeingMapped(const QSet<Window> &being_mapped, Window w) const;
     bool haveMappedWindow() const;
     bool x11EventFilter(XEvent *event, bool startup = false);
     bool processX11EventFilters(XEvent *event, bool after);
@@ -183,9 +193,39 @@ public:
     // handle a particular event.
     QMultiHash<int, MCompositeManagerExtension* > m_extensions;
 
+    // The same indexed by the event type, in the order the extensions
+    // are called.  Updated by installX11EventFilter(), so events nobody
+    // listens to only cost an isEmpty().  Each extension's time spent in
+    // the filters is kept in @ext_timings.
+    struct ExtensionHook {
+        ExtensionHook() : ext(0), timing(0) { }
+        MCompositeManagerExtension *ext;
+        int timing;
+    };
+    struct ExtensionTiming {
+        ExtensionTiming() : ext(0), calls(0), total_ns(0), max_ns(0) { }
+        const MCompositeManagerExtension *ext;
+        quint64 calls, total_ns, max_ns;
+    };
+    enum { MaxXEventType = 128 };
+    QVector<ExtensionHook> ext_dispatch[MaxXEventType];
+    QVector<ExtensionTiming> ext_timings;
+
     int damage_event;
     int damage_error;
 
+    // XSync event base or -1, and the _NET_WM_SYNC_REQUEST alarms
+    // of the windows.
+    int sync_event;
+    QHash<XID, Window> sync_alarms;
+
+    // Frames finished by the clients which we owe a _NET_WM_FRAME_DRAWN,
+    // sent once they have been painted.
+    QHash<Window, quint64> frames_drawn;
+    void frameDrawn(MCompositeWindow *cw, quint64 value);
+    void sendFrameDrawn(Window w, quint64 value);
+    void reportFrames();
+
     bool compositing;
     bool overlay_mapped;
     bool changed_properties;
@@ -208,6 +248,88 @@ public:
     Time stacking_timeout_timestamp;
     void dirtyStacking(bool force_visibility_check, Time t = CurrentTime);
     void pingTopmost();
+
+    // Damaged windows to be repaired when @damage_timer expires,
+    // with the timestamp of their last damage.
+    QTimer damage_timer;
+    QHash<Window, Time> pending_damage;
+
+    // Synthetic VisibilityNotify states and WM_STATEs to be sent to the
+    // clients by flushNotifications(), and the last VisibilityNotifys
+    // actually sent.
+    QHash<Window, int> pending_visibility, sent_visibility;
+    QHash<Window, int> pending_wm_state;
+    QTimer notify_timer;
+    void queueVisibility(Window w, int state, bool force = false);
+    void queueWindowState(Window w, int state);
+    void forgetNotifications(Window w);
+
+    // Running totals for MCompositeManager::dumpStateJson().
+    struct Counters {
+        Counters() : x_events(0), damage_events(0), repairs(0),
+                     stacking_checks(0), notifications(0),
+                     notifications_deduped(0), sleep_deferred(0) { }
+        quint64 x_events, damage_events, repairs, stacking_checks;
+        quint64 notifications, notifications_deduped, sleep_deferred;
+    } counters;
+
+    // Display-off power mode.  What can wait for the display to come on
+    // is noted in @sleep_log instead of being done, see sleepEssential().
+    bool deep_sleep;
+    struct SleepLog {
+        SleepLog() : stacking(false), visibility(false),
+                     timestamp(CurrentTime) { }
+        bool stacking, visibility;
+        Time timestamp;
+        // The changed properties the compositor hasn't reacted to yet.
+        struct Change {
+            Change() : state(PropertyNewValue), affects_stacking(false) { }
+            int state;
+            bool affects_stacking;
+        };
+        QHash<Window, QHash<Atom, Change> > properties;
+    } sleep_log;
+    bool sleepEssential() const;
+    bool deferWhileAsleep(bool force_visibility_check, Time timestamp);
+    void replayProperties(Window w,
+                          const QHash<Atom, SleepLog::Change> &changes);
+    void wakeUp();
+
+    // Display-on.  If the lockscreen or a low-power mode window is on top
+    // and its texture has been kept up to date it's shown right away, and
+    // the rest is done by finishUnblank() after @unblank_timer.
+    struct UnblankStats {
+        UnblankStats() : fast(0), slow(0), last_us(0), max_us(0) { }
+        unsigned fast, slow;
+        quint64 last_us, max_us;
+    } unblanks;
+    QTimer unblank_timer;
+    bool unblankReady() const;
+    void unblanked(bool fast, quint64 start_ns);
+
+    // Switches between compositing and direct rendering.  Compositing is
+    // kept on for holdTime() after it's no longer needed, so that brief
+    // windows like banners, dialogs and the VKB in succession don't make
+    // us flip back and forth.
+    struct SwitchStats {
+        SwitchStats() : to_composited(0), to_direct(0), held(0),
+                        total_us(0), max_us(0), direct_avg_ms(-1) { }
+        unsigned to_composited, to_direct, held;
+        quint64 total_us, max_us;
+        // Moving average of how long direct rendering has lasted.
+        int direct_avg_ms;
+        // Since the last switch.
+        QElapsedTimer since;
+    } switches;
+    QTimer unredirect_timer;
+    bool unredirect_now;
+    int holdTime() const;
+    bool holdCompositing();
+    void switched(bool to_compositing, quint64 start_ns);
+
+    // Records the events we get if it's set (the "record" command).
+    MEventRecorder *recorder;
+
     MSplashScreen *splash;
     QPointer<MCompositeWindow> waiting_damage;
     QSocketNotifier *sighupNotifier;
@@ -273,7 +395,12 @@ public slots:
     void displayOff(bool display_off);
     void callOngoing(bool call_ongoing);
     void stackingTimeout();
+    void repairPendingDamage();
+    void unredirectTimeout();
+    void finishUnblank();
+    void flushNotifications();
     void splashTimeout();
+    void applyConfig();
 };
 
 #endif
@@ -28,8 +28,10 @@
 #include "mcompositewindow.h"
 #include "mcompositescene.h"
 #include "mcompositewindowgroup.h"
+#include "mtexturepixmapitem_p.h"
 #include "mdecoratorframe.h"
 #include "mcompositemanager.h"
+#include "mxserverlatency.h"
 
 #include <X11/extensions/Xfixes.h>
 #ifdef HAVE_SHAPECONST
@@ -79,6 +81,62 @@ void MCompositeScene::prepareRoot(bool skip_wm_check)
         XSetErrorHandler(error_handler);
 }
 
+/*
+ * Reorder the bottom-to-top list of draws @order so that windows drawn
+ * with the same shader @programs follow each other, saving program
+ * switches.  A window is never moved over another one it overlaps,
+ * so the result is identical.  Program 0 means unknown (effects,
+ * groups), these draws are kept in place.
+ *
+ * This is done every frame, so it's a single pass from the bottom:
+ * if the lowest draw left has another program than the previous one,
+ * only the next BatchLookAhead draws are considered to be moved below it.
+ */
+void MCompositeScene::batchDraws(QVector<int> &order,
+                                 const QVector<unsigned> &programs,
+                                 const QVector<QRegion> &regions)
+{
+    int n = order.size();
+    if (n < 3)
+        return;
+
+    QVector<bool> done(n, false);
+    QVector<int> batched;
+    batched.reserve(n);
+    GLuint last = 0;
+    int first = 0;
+    for (int step = 0; step < n; ++step) {
+        while (done[first])
+            ++first;
+        int pick = first;
+        if (last && programs[first] && programs[first] != last) {
+            // is there a draw of @last not far above which can be
+            // drawn before everything left below it?
+            int seen = 0;
+            for (int j = first + 1; j < n && seen < BatchLookAhead; ++j) {
+                if (done[j])
+                    continue;
+                ++seen;
+                if (programs[j] != last)
+                    continue;
+                bool ready = true;
+                for (int k = first; k < j && ready; ++k)
+                    if (!done[k] && (!programs[k]
+                                     || regions[k].intersects(regions[j])))
+                        ready = false;
+                if (ready) {
+                    pick = j;
+                    break;
+                }
+            }
+        }
+        done[pick] = true;
+        last = programs[pick];
+        batched.append(order[pick]);
+    }
+    order = batched;
+}
+
 void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *items[], const QStyleOptionGraphicsItem options[], QWidget *widget)
 {
     if (keep_black) {
@@ -93,8 +151,13 @@ void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *
     if (mc->servergrab.hasGrab())
         mc->servergrab.reinforce();
 
+    // Let xserverping sample faster while we're animating.
+    if (MXServerLatency *latency = MXServerLatency::instance())
+        latency->frameDrawn();
+
     QRegion visible(sceneRect().toRect());
     QVector<int> to_paint(10);
+    QVector<QRegion> to_paint_r(10);
     int size = 0;
     // visibility is determined from top to bottom
     for (int i = numItems - 1; i >= 0; --i) {
@@ -142,8 +205,11 @@ void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *
         // all transitioning windows
         if (cw->isWindowTransitioning() || visible.intersects(r)
             || cw->type() == MCompositeWindowGroup::Type) {
-            if (size >= 9)
+            if (size >= 9) {
                 to_paint.resize((unsigned)to_paint.size()+1);
+                to_paint_r.resize(to_paint.size());
+            }
+            to_paint_r[size] = r;
             to_paint[size++] = i;
         }
 
@@ -158,8 +224,21 @@ void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *
     glClear(GL_COLOR_BUFFER_BIT);
     if (size > 0) {
         // paint from bottom to top so that blending works
-        for (int i = size - 1; i >= 0; --i) {
-            int item_i = to_paint[i];
+        QVector<int> order(size);
+        QVector<GLuint> programs(size);
+        QVector<QRegion> regions(size);
+        for (int i = size - 1, j = 0; i >= 0; --i, ++j) {
+            MCompositeWindow *cw = (MCompositeWindow*)items[to_paint[i]];
+            order[j] = to_paint[i];
+            regions[j] = to_paint_r[i];
+            programs[j] = cw->type() == MCompositeWindowGroup::Type
+                          || cw->isWindowTransitioning() || !cw->renderer()
+                          ? 0 : cw->renderer()->shaderProgramId();
+        }
+        batchDraws(order, programs, regions);
+
+        for (int i = 0; i < size; ++i) {
+            int item_i = order[i];
             MCompositeWindow *cw = (MCompositeWindow*)items[item_i];
             if (cw->propertyCache()->isDecorator()
                 && !MDecoratorFrame::instance()->managedClient()) {
@@ -174,4 +253,5 @@ void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *
             painter->restore();
         }
     }
+    mc->framePainted();
 }
@@ -22,6 +22,8 @@
 
 #include <QGraphicsScene>
 #include <QGraphicsItem>
+#include <QVector>
+#include <QRegion>
 #include <X11/Xlib.h>
 #include <map>
 
@@ -54,6 +56,13 @@ public:
 
     bool keep_black;
 
+    // Reorders the draws of a frame to save shader program switches,
+    // see mcompositescene.cpp.  Public for the unit tests.
+    enum { BatchLookAhead = 8 };
+    static void batchDraws(QVector<int> &order,
+                           const QVector<unsigned> &programs,
+                           const QVector<QRegion> &regions);
+
 protected:
     void drawItems(QPainter *painter, int numItems, QGraphicsItem *items[], const QStyleOptionGraphicsItem options[], QWidget *widget);
 
@@ -28,13 +28,16 @@
 #include "msplashscreen.h"
 #include "mdynamicanimation.h"
 #include "mdevicestate.h"
+#include "mtimerwheel.h"
 
 #include <QX11Info>
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
 #include <X11/Xatom.h>
+#include <X11/extensions/sync.h>
 
 int MCompositeWindow::window_transitioning = 0;
+QSet<MCompositeWindow*> MCompositeWindow::visible_translucent;
 
 MCompositeWindow::MCompositeWindow(Qt::HANDLE window, 
                                    MWindowPropertyCache *mpc, 
@@ -55,33 +58,35 @@ MCompositeWindow::MCompositeWindow(Qt::HANDLE window,
       resize_expected(false),
       painted_after_mapping(false),
       allow_delete(false),
-      win_id(window)
+      win_id(window),
+      sync_alarm(None),
+      sync_serial(0),
+      sync_pending(false),
+      frame_alarm(None)
 {
-    const MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
+    close_timer = new MWheelTimer(this);
+    close_timer->setSingleShot(true);
+    connect(close_timer, SIGNAL(timeout()), SLOT(closeTimeout()));
 
     if (!mpc || (mpc && !mpc->is_valid && !mpc->isVirtual())) {
         newly_mapped = false;
         t_ping = t_reappear = damage_timer = 0;
+        applyConfig();
         return;
     }
     connect(mpc, SIGNAL(iconGeometryUpdated()), SLOT(updateIconGeometry()));
 
-    t_ping = new QTimer(this);
-    t_ping->setInterval(mc->configInt("ping-interval-ms"));
+    t_ping = new MWheelTimer(this);
     connect(t_ping, SIGNAL(timeout()), SLOT(pingTimeout()));
-    t_reappear = new QTimer(this);
+    t_reappear = new MWheelTimer(this);
     t_reappear->setSingleShot(true);
-    t_reappear->setInterval(mc->configInt("hung-dialog-reappear-ms"));
     connect(t_reappear, SIGNAL(timeout()), SLOT(reappearTimeout()));
+    applyConfig();
 
-    damage_timer = new QTimer(this);
+    damage_timer = new MWheelTimer(this);
     damage_timer->setSingleShot(true);
     connect(damage_timer, SIGNAL(timeout()), SLOT(damageReceived()));
 
-    close_timer.setSingleShot(true);
-    close_timer.setInterval(mc->configInt("close-timeout-ms"));
-    connect(&close_timer, SIGNAL(timeout()), SLOT(closeTimeout()));
-
     // Newly-mapped non-decorated application windows are not initially 
     // visible to prevent flickering when animation is started.
     // We initially prevent item visibility from compositor itself
@@ -112,6 +117,15 @@ MCompositeWindow::~MCompositeWindow()
     in_destructor = true;
 
     endAnimation();    
+    visible_translucent.remove(this);
+    if (sync_alarm) {
+        XSyncDestroyAlarm(QX11Info::display(), sync_alarm);
+        p->d->sync_alarms.remove(sync_alarm);
+    }
+    if (frame_alarm) {
+        XSyncDestroyAlarm(QX11Info::display(), frame_alarm);
+        p->d->sync_alarms.remove(frame_alarm);
+    }
     if (pc) {
         pc->damageTracking(false);
         if (p->d->prop_caches.value(win_id) == pc) {
@@ -194,16 +208,11 @@ void MCompositeWindow::setWindowObscured(bool obscured, bool no_notify)
         return;
     window_obscured = new_value;
 
-    if (!no_notify && !pc->isVirtual()) {
-        XVisibilityEvent c;
-        c.type       = VisibilityNotify;
-        c.send_event = True;
-        c.window     = window();
-        c.state      = obscured ? VisibilityFullyObscured :
-                                  VisibilityUnobscured;
-        XSendEvent(QX11Info::display(), window(), true,
-                   VisibilityChangeMask, (XEvent *)&c);
-    }
+    if (!no_notify && !pc->isVirtual())
+        // a newly mapped window is told even if it's been told before
+        p->d->queueVisibility(window(), obscured ? VisibilityFullyObscured
+                                                 : VisibilityUnobscured,
+                              newly_mapped);
 }
 
 /*
@@ -255,16 +264,134 @@ void MCompositeWindow::restore()
     }
 }
 
+void MCompositeWindow::applyConfig()
+{
+    const MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
+
+    close_timer->setInterval(mc->cfg().close_timeout_ms);
+    if (t_ping)
+        t_ping->setInterval(mc->cfg().ping_interval_ms);
+    if (t_reappear)
+        t_reappear->setInterval(mc->cfg().hung_dialog_reappear_ms);
+}
+
+// Ask the client to update its _NET_WM_SYNC_REQUEST_COUNTER when it has
+// drawn its next frame.  Returns false if it doesn't support it.
+bool MCompositeWindow::requestSync()
+{
+    MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
+    Display *dpy = QX11Info::display();
+    XID counter;
+
+    if (mc->d->sync_event < 0 || !pc || !pc->is_valid
+        || !pc->supportedProtocols().contains(ATOM(_NET_WM_SYNC_REQUEST))
+        || !(counter = pc->syncCounter()))
+        return false;
+
+    if (!sync_serial) {
+        // Start from the counter's value, otherwise the alarm may
+        // trigger before the client has done anything.
+        XSyncValue value;
+        if (!XSyncQueryCounter(dpy, counter, &value))
+            return false;
+        sync_serial = (quint64(XSyncValueHigh32(value)) << 32)
+                      | XSyncValueLow32(value);
+    }
+    sync_serial++;
+
+    // Get an XSyncAlarmNotify when the counter reaches @sync_serial.
+    XSyncAlarmAttributes attrs;
+    const unsigned long mask = XSyncCACounter | XSyncCAValueType
+        | XSyncCAValue | XSyncCATestType | XSyncCAEvents;
+    attrs.trigger.counter = counter;
+    attrs.trigger.value_type = XSyncAbsolute;
+    attrs.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntsToValue(&attrs.trigger.wait_value,
+                     sync_serial & 0xffffffff, sync_serial >> 32);
+    attrs.events = True;
+    if (sync_alarm) {
+        XSyncChangeAlarm(dpy, sync_alarm, mask, &attrs);
+    } else {
+        sync_alarm = XSyncCreateAlarm(dpy, mask, &attrs);
+        mc->d->sync_alarms[sync_alarm] = window();
+    }
+
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = window();
+    ev.xclient.message_type = ATOM(WM_PROTOCOLS);
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = ATOM(_NET_WM_SYNC_REQUEST);
+    ev.xclient.data.l[1] = CurrentTime;
+    ev.xclient.data.l[2] = sync_serial & 0xffffffff;
+    ev.xclient.data.l[3] = sync_serial >> 32;
+    XSendEvent(dpy, window(), False, NoEventMask, &ev);
+
+    sync_pending = true;
+    return true;
+}
+
+void MCompositeWindow::watchFrames()
+{
+    MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
+    XID counter;
+
+    // The counter may have been replaced.
+    if (frame_alarm) {
+        XSyncDestroyAlarm(QX11Info::display(), frame_alarm);
+        mc->d->sync_alarms.remove(frame_alarm);
+        frame_alarm = None;
+    }
+
+    if (mc->d->sync_event < 0 || !pc || !pc->is_valid
+        || !pc->supportedProtocols().contains(ATOM(_NET_WM_SYNC_REQUEST))
+        || !(counter = pc->frameCounter()))
+        return;
+
+    // The client makes the counter odd when it starts a frame and even
+    // when it's finished.  The test value is moved past the counter after
+    // each trigger, so we hear about every increment.
+    XSyncAlarmAttributes attrs;
+    const unsigned long mask = XSyncCACounter | XSyncCAValueType
+        | XSyncCAValue | XSyncCATestType | XSyncCADelta | XSyncCAEvents;
+    attrs.trigger.counter = counter;
+    attrs.trigger.value_type = XSyncRelative;
+    attrs.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntToValue(&attrs.trigger.wait_value, 1);
+    XSyncIntToValue(&attrs.delta, 1);
+    attrs.events = True;
+    frame_alarm = XSyncCreateAlarm(QX11Info::display(), mask, &attrs);
+    mc->d->sync_alarms[frame_alarm] = window();
+}
+
+void MCompositeWindow::syncCompleted()
+{
+    if (!sync_pending)
+        return;
+    sync_pending = false;
+
+    if (damage_timer && damage_timer->isActive()) {
+        // The frame is there (its damage came before the alarm),
+        // no need to wait any more.  Simulate a timeout.
+        resize_expected = false;
+        damage_timer->stop();
+        damageReceived();
+    }
+}
+
 void MCompositeWindow::waitForPainting()
 {
     const MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
     setWindowObscured(false);
-    // waiting for two damage events seems to work for Meegotouch apps
-    // at least, for the rest, there is a timeout
-    pc->setWaitingForDamage(mc->configInt("damages-for-starting-anim"));
+    // If the client supports it it tells us when it has drawn the frame,
+    // otherwise waiting for two damage events seems to work for
+    // Meegotouch apps at least, for the rest, there is a timeout.
+    pc->setWaitingForDamage(requestSync() ? 1
+                            : mc->cfg().damages_for_starting_anim);
     resize_expected = false;
     painted_after_mapping = false;
-    damage_timer->setInterval(mc->configInt("damage-timeout-ms"));
+    damage_timer->setInterval(mc->cfg().damage_timeout_ms);
     damage_timer->start();
 }
 
@@ -307,7 +434,10 @@ void MCompositeWindow::expectResize()
     if (!damage_timer->isActive())
         return;
     resize_expected = true;
-    damage_timer->setInterval(mc->configInt("expect-resize-timeout-ms"));
+    // Wait for the frame after the resize instead of the current one.
+    if (sync_pending)
+        requestSync();
+    damage_timer->setInterval(mc->cfg().expect_resize_timeout_ms);
 }
 
 void MCompositeWindow::damageReceived()
@@ -321,6 +451,9 @@ void MCompositeWindow::damageReceived()
         pc->setWaitingForDamage(0);
         return;
     } else if (damage_timer->isActive()) {
+        if (sync_pending)
+            // We'll know from syncCompleted() when it's finished.
+            return;
         // We're within timeout and just got a damage.
         Q_ASSERT(pc->waitingForDamage() > 0);
         int waiting_for_damage = pc->waitingForDamage();
@@ -592,12 +725,12 @@ void MCompositeWindow::closeTimeout()
 
 void MCompositeWindow::startCloseTimer()
 {
-    close_timer.start();
+    close_timer->start();
 }
 
 void MCompositeWindow::stopCloseTimer()
 {
-    close_timer.stop();
+    close_timer->stop();
 }
 
 void MCompositeWindow::receivedPing(ulong serverTimeStamp)
@@ -714,6 +847,14 @@ bool MCompositeWindow::hasTransitioningWindow()
     return window_transitioning > 0;
 }
 
+void MCompositeWindow::updateTranslucency()
+{
+    if (!in_destructor && pc && isVisible() && pc->hasAlphaAndIsNotOpaque())
+        visible_translucent.insert(this);
+    else
+        visible_translucent.remove(this);
+}
+
 QVariant MCompositeWindow::itemChange(GraphicsItemChange change, const QVariant &value)
 {
     MCompositeManager *p = (MCompositeManager *) qApp;
@@ -724,6 +865,8 @@ QVariant MCompositeWindow::itemChange(GraphicsItemChange change, const QVariant
 #endif
 
     if (change == ItemVisibleHasChanged) {
+        updateTranslucency();
+
         // Be careful not to update if this item whose visibility is about
         // to change is behind a visible item, to not reopen NB#189519.
         // Update is needed if visibility changes for a visible item
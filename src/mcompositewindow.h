@@ -31,6 +31,7 @@ class MTexturePixmapPrivate;
 class MCompositeWindowGroup;
 class MCompositeWindowAnimation;
 class McParallelAnimation;
+class MWheelTimer;
 
 /*!
  * This is the base class for composited window items. It provided general
@@ -207,6 +208,18 @@ public:
 
     static bool hasTransitioningWindow();
 
+    /*!
+     * Returns whether any window is visible and hasAlphaAndIsNotOpaque().
+     */
+    static bool hasVisibleTranslucentWindow()
+        { return !visible_translucent.isEmpty(); }
+
+    /*!
+     * Updates this window's part in hasVisibleTranslucentWindow().
+     * Called when its visibility or _MEEGOTOUCH_OPAQUE_WINDOW changes.
+     */
+    void updateTranslucency();
+
     /*!
      * Tells if this window is transitioning.
      */
@@ -233,10 +246,9 @@ public:
 
     bool isClosing() const { return window_status == Closing; }
 
-#ifdef WINDOW_DEBUG
+    // For the "hang" command and to restore the state after a restart.
     void hangIt() { window_status = Hung; }
     bool isHung() const { return window_status == Hung; }
-#endif
 
     MWindowPropertyCache *propertyCache() const { return pc; }
     void setPropertyCache(MWindowPropertyCache *p) { pc = p; }
@@ -312,6 +324,26 @@ public slots:
      */
     void startDialogReappearTimer();
 
+    /*!
+     * Takes the timeouts from MCompositeManager::cfg() again.
+     */
+    void applyConfig();
+
+    /*!
+     * Called when the client has updated its _NET_WM_SYNC_REQUEST_COUNTER
+     * as we asked, ie. it has drawn the frame we're waiting for.
+     */
+    void syncCompleted();
+
+    /*!
+     * Creates an alarm on the client's frame counter (the second one of
+     * _NET_WM_SYNC_REQUEST_COUNTER) if it has one, so that we can send it
+     * _NET_WM_FRAME_DRAWN when we've painted its frames.  Call it again
+     * when _NET_WM_SYNC_REQUEST_COUNTER changes to replace the alarm.
+     */
+    void watchFrames();
+    XID frameAlarm() const { return frame_alarm; }
+
 private slots:
 
     /*! Called internally to update how this item looks when the transitions
@@ -357,6 +389,7 @@ private:
     virtual MTexturePixmapPrivate* renderer() const = 0;
     void findBehindWindow();
     bool isInanimate(bool check_pixmap = true);
+    bool requestSync();
     void setAllowDelete(bool setting) { allow_delete = setting; }
 
     QPointer<MWindowPropertyCache> pc;
@@ -376,14 +409,24 @@ private:
     bool allow_delete;
 
     static int window_transitioning;
+    static QSet<MCompositeWindow*> visible_translucent;
 
     // Main ping timer
-    QTimer *t_ping, *t_reappear;
-    QTimer *damage_timer;
-    QTimer close_timer;
+    MWheelTimer *t_ping, *t_reappear;
+    MWheelTimer *damage_timer;
+    MWheelTimer *close_timer;
     Qt::HANDLE win_id;
 
+    // _NET_WM_SYNC_REQUEST state: the alarm on the client's counter,
+    // the last value we asked for and whether it's yet to be reached.
+    XID sync_alarm;
+    quint64 sync_serial;
+    bool sync_pending;
+    // Alarm on the frame counter, triggered on every change of it.
+    XID frame_alarm;
+
     friend class MTexturePixmapPrivate;
+    friend class MCompositeScene;
     friend class MCompositeWindowShaderEffect;
     friend class MCompositeWindowAnimation;
     friend class MChainedAnimation;
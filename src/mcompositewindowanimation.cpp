@@ -122,7 +122,7 @@ public:
         int duration = 300;
         if (!mc->hasPlugins())
             // dont bork the animation if we dont have a plugin
-            duration = mc->configInt("startup-anim-duration");
+            duration = mc->cfg().startup_anim_duration;
 
         scale = new QPropertyAnimation(animation);
         scale->setPropertyName("scale");
@@ -377,7 +377,7 @@ void MCompositeWindowAnimation::crossFadeTo(MCompositeWindow *cw)
     op->setTargetObject(cw);
     op->setEasingCurve(QEasingCurve::Linear);
     op->setPropertyName("opacity");
-    op->setDuration(mc->configInt("crossfade-duration"));
+    op->setDuration(mc->cfg().crossfade_duration);
     op->setStartValue(0);
     op->setEndValue(1);
     d->crossfade->addAnimation(op);
@@ -316,6 +316,61 @@ void MCompositeWindowGroup::updateWindowPixmap(XRectangle *rects, int num,
     Q_UNUSED(rects)
     Q_UNUSED(num)
     Q_UNUSED(t)
+
+    renderGroup(QRect());
+}
+
+// Called by a member @window when @damage (in its own coordinates) needs
+// to be repaired.  Only that part of the FBO is redrawn, and only if it's
+// not covered by an opaque member stacked above @window.
+//
+// Damage is reported to us with XDamageReportNonEmpty and repaired with
+// updateWindowPixmap(0, 0), so in practice @damage is the whole of @window:
+// the clip is per member, not per damaged rectangle.
+void MCompositeWindowGroup::memberDamaged(MTexturePixmapItem *window,
+                                          const QRegion &damage)
+{
+    Q_D(MCompositeWindowGroup);
+
+    if (!d->main_window)
+        return;
+
+    int i = 0;
+    if (window != d->main_window) {
+        i = d->item_list.indexOf(window);
+        if (i < 0) {
+            renderGroup(QRect());
+            return;
+        }
+        ++i;
+    }
+
+    QRegion r = window->sceneTransform().map(damage);
+    for (; i < d->item_list.size() && !r.isEmpty(); ++i) {
+        MTexturePixmapItem *above = d->item_list[i];
+        if (above->propertyCache()->hasAlphaAndIsNotOpaque()
+            || above->opacity() < 1.0)
+            continue;
+        QRegion shape = above->propertyCache()->shapeRegion();
+        shape.translate(-above->propertyCache()->realGeometry().x(),
+                        -above->propertyCache()->realGeometry().y());
+        r -= above->sceneTransform().map(shape);
+    }
+
+    if (r.isEmpty())
+        // what changed is not visible in the group
+        return;
+
+    // the FBO is the size of @main_window, flip to GL coordinates
+    QRect box = r.boundingRect();
+    box.moveTop(d->main_window->boundingRect().height() - box.bottom() - 1);
+    renderGroup(box);
+}
+
+// Renders @main_window and all children into the FBO, limited to @clip
+// (in GL coordinates) unless it's null.
+void MCompositeWindowGroup::renderGroup(const QRect &clip)
+{
     Q_D(MCompositeWindowGroup);
 
     if (!d->main_window)
@@ -341,19 +396,24 @@ void MCompositeWindowGroup::updateWindowPixmap(XRectangle *rects, int num,
     }
     bool orig_value = d->main_window->d->inverted_texture;
     d->main_window->d->inverted_texture = false;
+    d->main_window->d->clip_rect = clip;
     // The redirection method is expected not to play with GL_FRAMEBUFFER.
     d->main_window->enableRedirectedRendering();
     d->main_window->renderTexture(d->main_window->sceneTransform());
     d->main_window->d->inverted_texture = orig_value;
+    d->main_window->d->clip_rect = QRect();
     for (int i = 0; i < d->item_list.size(); ++i) {
         MTexturePixmapItem* item = d->item_list[i];
         orig_value = item->d->inverted_texture;
         item->d->inverted_texture = false;
+        item->d->clip_rect = clip;
         item->enableRedirectedRendering();
         item->renderTexture(item->sceneTransform());
         item->d->inverted_texture = orig_value;
+        item->d->clip_rect = QRect();
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    d->renderer->invalidateBlurCache();
 }
 
 // internal re-implementation from MCompositeWindow
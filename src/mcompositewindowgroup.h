@@ -61,9 +61,12 @@ class MCompositeWindowGroup: public MCompositeWindow
  private:
     Q_DECLARE_PRIVATE(MCompositeWindowGroup)       
     void init();
+    void memberDamaged(MTexturePixmapItem *window, const QRegion &damage);
+    void renderGroup(const QRect &clip);
     virtual MTexturePixmapPrivate* renderer() const;
     
     QScopedPointer<MCompositeWindowGroupPrivate> d_ptr;
+    friend class MTexturePixmapItem;
 };
 
 #endif // MCOMPOSITEWINDOWGROUP_H
@@ -47,7 +47,9 @@ MCompositeWindowShaderEffectPrivate::MCompositeWindowShaderEffectPrivate(MCompos
     :effect(e),
      priv_render(0),
      comp_window(0),
-     active_fragment(0)
+     active_fragment(0),
+     blur_radius(1.0),
+     blur_passes(2)
 {
 }
 
@@ -110,6 +112,20 @@ GLuint MCompositeWindowShaderEffect::installShaderFragment(const QByteArray& cod
     return id;
 }
 
+/*!
+  Schedules the pixel shader fragment \a code to be compiled in the
+  background, when the compositor is idle, so that a later
+  installShaderFragment() with the same \a code doesn't stall the first
+  frame of the effect.  Plugins should call this for their fragments at
+  load time if they construct their effects lazily.
+
+  \sa installShaderFragment()
+*/
+void MCompositeWindowShaderEffect::precompileShaderFragment(const QByteArray& code)
+{
+    MTexturePixmapPrivate::precompilePixelShader(code);
+}
+
  /*!
    \return Texture id of the currently rendered window
  */
@@ -199,6 +215,60 @@ void MCompositeWindowShaderEffect::drawSource(const QTransform &transform,
 }
 
 
+/*!
+  Draws a blurred copy of the currently bound source window texture.
+  The arguments are the same as for drawSource(); the strength of the blur
+  is determined by blurRadius() and blurQuality().  The blurred image is
+  cached and only recomputed when the window is damaged or the parameters
+  change, so it is cheap to draw every frame.
+  This function should only be called inside drawTexture()
+
+  \sa setBlurRadius(), setBlurQuality()
+*/
+void MCompositeWindowShaderEffect::drawBlurredSource(const QTransform &transform,
+                                                     const QRectF &drawRect,
+                                                     qreal opacity)
+{
+    if (d->priv_render)
+        d->priv_render->drawBlurredTexture(transform, drawRect, opacity,
+                                           d->blur_radius, d->blur_passes);
+}
+
+/*!
+  Sets the distance of the samples of each blur pass to \a radius texels
+  of the downsampled image.  The default is 1.0.
+*/
+void MCompositeWindowShaderEffect::setBlurRadius(qreal radius)
+{
+    d->blur_radius = radius;
+}
+
+/*!
+  \return The blur radius used by drawBlurredSource()
+*/
+qreal MCompositeWindowShaderEffect::blurRadius() const
+{
+    return d->blur_radius;
+}
+
+/*!
+  Sets the number of times the image is halved in size while blurring
+  to \a passes (1 - 4).  More passes give a stronger, smoother blur at
+  little extra cost.  The default is 2.
+*/
+void MCompositeWindowShaderEffect::setBlurQuality(int passes)
+{
+    d->blur_passes = qBound(1, passes, 4);
+}
+
+/*!
+  \return The number of downsampling passes used by drawBlurredSource()
+*/
+int MCompositeWindowShaderEffect::blurQuality() const
+{
+    return d->blur_passes;
+}
+
 /*!
   Install this effect on a composite window object \a window. Note that
   we override QGraphicsItem::setGraphicsEffect() because
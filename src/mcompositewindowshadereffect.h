@@ -39,10 +39,16 @@ class MCompositeWindowShaderEffect: public QObject
     virtual ~MCompositeWindowShaderEffect();
     
     GLuint installShaderFragment(const QByteArray& code);
+    static void precompileShaderFragment(const QByteArray& code);
     GLuint texture() const;
     void setActiveShaderFragment(GLuint id);
     GLuint activeShaderFragment() const;
 
+    void setBlurRadius(qreal radius);
+    qreal blurRadius() const;
+    void setBlurQuality(int passes);
+    int blurQuality() const;
+
     virtual void installEffect(MCompositeWindow* window);
     void removeEffect(MCompositeWindow* window);
     bool enabled() const;
@@ -61,6 +67,8 @@ class MCompositeWindowShaderEffect: public QObject
     void drawSource(const QTransform &transform,
                     const QRectF &drawRect, qreal opacity,
                     const GLvoid* texCoords);
+    void drawBlurredSource(const QTransform &transform,
+                           const QRectF &drawRect, qreal opacity);
     virtual void drawTexture(const QTransform &transform,
                              const QRectF &drawRect, qreal opacity) = 0;
     virtual void setUniforms(QGLShaderProgram* program);
@@ -96,6 +104,8 @@ class MCompositeWindowShaderEffectPrivate
     MCompositeWindow *comp_window;
     QVector<GLuint> pixfrag_ids;
     GLuint active_fragment;
+    qreal blur_radius;
+    int blur_passes;
     
     bool enabled;
 
@@ -23,8 +23,10 @@
 #include "mcompositemanager.h"
 #include "mcompositordebug.h"
 #include "mrmi.h"
+#include "mabstractdecorator.h"
 
 #include <QX11Info>
+#include <QDataStream>
 
 #include <X11/Xutil.h>
 #include <X11/Xlib.h>
@@ -38,14 +40,22 @@ MDecoratorFrame::MDecoratorFrame(QObject *p)
       client(0),
       decorator_window(0),
       decorator_item(0),
+      no_resize(false),
+      only_statusbar(false),
+      show_dialog(false),
+      decorator_knows(false),
+      sent_window(0),
       sent_orientation(-1),
-      sent_show_dialog(false),
-      no_resize(false)
+      sent_only_statusbar(false),
+      sent_show_dialog(false)
 {    
     // One instance at a time
     Q_ASSERT(!d);
     d = this;
 
+    update_timer.setSingleShot(true);
+    connect(&update_timer, SIGNAL(timeout()), SLOT(sendUpdate()));
+
     remote_decorator = new MRmiClient(".mabstractdecorator", this);
     remote_decorator->exportObject(this);
 }
@@ -72,29 +82,74 @@ void MDecoratorFrame::show()
         decorator_item->setVisible(true);
 }
 
-void MDecoratorFrame::sendManagedWindowId(bool show_dialog)
+void MDecoratorFrame::scheduleUpdate()
 {
-    QVector<QVariant> args;
+    if (!update_timer.isActive())
+        update_timer.start(0);
+}
 
+// Tell the decorator what has changed since the last time.
+void MDecoratorFrame::sendUpdate()
+{
+    update_timer.stop();
+    if (!decorator_item)
+        // It will need everything when it's back.
+        return;
+
+    unsigned window = 0, orientation = 0;
+    QRect geometry;
+    QString wm_name;
     if (client) {
         MWindowPropertyCache *pc = client->propertyCache();
-        args << unsigned(client->window())
-             << pc->requestedGeometry()
-             << pc->wmName()
-             << pc->orientationAngle()
-             << only_statusbar
-             << show_dialog;
-        sent_orientation = pc->orientationAngle();
-        sent_show_dialog = show_dialog;
+        window = client->window();
+        geometry = pc->requestedGeometry();
+        wm_name = pc->wmName();
+        orientation = pc->orientationAngle();
+    }
+
+    // Changing the managed window, its orientation or the dialog makes
+    // the decorator re-read the window title and geometry too, while
+    // the "only statusbar" mode can be changed alone.
+    unsigned changed = 0;
+    if (!decorator_knows) {
+        changed = MAbstractDecorator::AllFields;
     } else {
-        args << unsigned(0) << QRect() << QString() << unsigned(0)
-             << false << false;
-        sent_orientation = -1;
-        sent_show_dialog = false;
+        if (window != sent_window)
+            changed |= MAbstractDecorator::WindowField;
+        if ((int)orientation != sent_orientation)
+            changed |= MAbstractDecorator::OrientationField;
+        if (show_dialog != sent_show_dialog)
+            changed |= MAbstractDecorator::ShowDialogField;
+        if (changed && geometry != sent_geometry)
+            changed |= MAbstractDecorator::GeometryField;
+        if (changed && wm_name != sent_wm_name)
+            changed |= MAbstractDecorator::WmNameField;
+        if (only_statusbar != sent_only_statusbar)
+            changed |= MAbstractDecorator::OnlyStatusbarField;
     }
+    if (!changed)
+        return;
+
+    QByteArray fields;
+    QDataStream out(&fields, QIODevice::WriteOnly);
+    if (changed & MAbstractDecorator::WindowField)
+        out << quint32(sent_window = window);
+    if (changed & MAbstractDecorator::GeometryField)
+        out << (sent_geometry = geometry);
+    if (changed & MAbstractDecorator::WmNameField)
+        out << (sent_wm_name = wm_name);
+    if (changed & MAbstractDecorator::OrientationField) {
+        out << quint32(orientation);
+        sent_orientation = orientation;
+    }
+    if (changed & MAbstractDecorator::OnlyStatusbarField)
+        out << (sent_only_statusbar = only_statusbar);
+    if (changed & MAbstractDecorator::ShowDialogField)
+        out << (sent_show_dialog = show_dialog);
+    decorator_knows = true;
 
-    remote_decorator->invoke("MAbstractDecorator", "RemoteSetManagedWinId",
-                             args);
+    remote_decorator->invoke("MAbstractDecorator", "RemoteUpdateManagedWin",
+                             QVector<QVariant>() << changed << fields);
 }
 
 void MDecoratorFrame::setManagedWindow(MCompositeWindow *cw,
@@ -104,21 +159,16 @@ void MDecoratorFrame::setManagedWindow(MCompositeWindow *cw,
 {    
     this->no_resize = no_resize;
     this->only_statusbar = only_statusbar;
+    this->show_dialog = cw ? show_dialog : false;
+    scheduleUpdate();
 
-    if (client == cw) {
-        if (cw && (show_dialog != sent_show_dialog ||
-            sent_orientation != (int)cw->propertyCache()->orientationAngle()))
-            // Time to @show_dialog again or orientation changed.
-            sendManagedWindowId(show_dialog);
+    if (client == cw)
         return;
-    }
 
     if (client)
         disconnect(client, SIGNAL(destroyed()), this, SLOT(destroyClient()));
     client = cw;
 
-    if (decorator_item)
-        sendManagedWindowId(show_dialog);
     if (cw) {
         if (!no_resize)
             cw->expectResize();
@@ -134,12 +184,15 @@ void MDecoratorFrame::showQueryDialog(MCompositeWindow *cw,
 
 void MDecoratorFrame::hideQueryDialog()
 {
+    // Don't overtake the state changes.
+    sendUpdate();
     remote_decorator->invoke("MAbstractDecorator",
                              "RemoteHideQueryDialog");
 }
 
 void MDecoratorFrame::playFeedback(const QString &name)
 {
+    sendUpdate();
     remote_decorator->invoke("MAbstractDecorator",
                              "RemotePlayFeedback", name);
 }
@@ -147,8 +200,7 @@ void MDecoratorFrame::playFeedback(const QString &name)
 void MDecoratorFrame::setOnlyStatusbar(bool mode)
 {
     only_statusbar = mode;
-    remote_decorator->invoke("MAbstractDecorator",
-                             "RemoteSetOnlyStatusbar", mode);
+    scheduleUpdate();
 }
 
 void MDecoratorFrame::queryDialogAnswer(unsigned window, bool killit)
@@ -172,7 +224,8 @@ void MDecoratorFrame::setDecoratorItem(MCompositeWindow *window)
     MTexturePixmapItem *item = (MTexturePixmapItem *) window;
     if (!decorator_window)
         setDecoratorWindow(item->window());
-    sendManagedWindowId(sent_show_dialog);
+    decorator_knows = false;
+    sendUpdate();
 }
 
 MCompositeWindow *MDecoratorFrame::decoratorItem() const
@@ -185,12 +238,16 @@ void MDecoratorFrame::destroyDecorator()
     decoratorRectChanged(QRect());
     decorator_item = 0;
     decorator_window = 0;
+    decorator_knows = false;
 }
 
 void MDecoratorFrame::destroyClient()
 {
-    if (client == sender())
+    if (client == sender()) {
         client = 0;
+        show_dialog = false;
+        scheduleUpdate();
+    }
 }
 
 void MDecoratorFrame::decoratorRectChanged(const QRect& r)
@@ -22,6 +22,7 @@
 
 #include <QObject>
 #include <QRect>
+#include <QTimer>
 
 class MCompositeWindow;
 class MRmiClient;
@@ -110,9 +111,10 @@ private slots:
     void queryDialogAnswer(unsigned window, bool killit);
     void destroyDecorator();
     void destroyClient();
+    void sendUpdate();
 
 private:
-    void sendManagedWindowId(bool show_dialog = false);
+    void scheduleUpdate();
     static MDecoratorFrame *d;
 
     MCompositeWindow *client;
@@ -120,10 +122,20 @@ private:
     MCompositeWindow *decorator_item;
     MRmiClient *remote_decorator;
     int top_offset;
-    int sent_orientation;
-    bool sent_show_dialog;
-    bool no_resize, only_statusbar;
+    bool no_resize, only_statusbar, show_dialog;
     QRect available_rect;
+
+    // What the decorator has been told.  It needs everything if
+    // !decorator_knows.
+    bool decorator_knows;
+    unsigned sent_window;
+    QRect sent_geometry;
+    QString sent_wm_name;
+    int sent_orientation;
+    bool sent_only_statusbar, sent_show_dialog;
+
+    // Sends the changes of the current event batch to the decorator.
+    QTimer update_timer;
 };
 
 #endif // DUIDECORATORFRAME_H
@@ -165,7 +165,7 @@ MSheetAnimation::MSheetAnimation(QObject* parent)
 
     // From the UX specs
     const MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
-    int duration = mc->configInt("sheet-anim-duration", 350);
+    int duration = mc->cfg().sheet_anim_duration;
     positionAnimation()->setDuration(duration);
     activeAnimations().append(positionAnimation());
     cropper = new MStatusBarCrop(this);
@@ -256,7 +256,7 @@ MChainedAnimation::MChainedAnimation(QObject* parent)
 
     // UX subview specs    
     const MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
-    int duration = mc->configInt("chained-anim-duration", 500);
+    int duration = mc->cfg().chained_anim_duration;
     positionAnimation()->setDuration(duration);
     positionAnimation()->setEasingCurve(QEasingCurve::InOutExpo);
 
@@ -396,7 +396,7 @@ MCallUiAnimation::MCallUiAnimation(QObject* parent)
 
     // UX call-ui specs
     const MCompositeManager *mc = static_cast<MCompositeManager*>(qApp);
-    int duration = mc->configInt("callui-anim-duration", 400);
+    int duration = mc->cfg().callui_anim_duration;
     currentwin_pos = new QPropertyAnimation(this);
     currentwin_pos->setPropertyName("pos");
     currentwin_pos->setEasingCurve(QEasingCurve::InOutCubic);
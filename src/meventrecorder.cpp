@@ -0,0 +1,317 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "meventrecorder.h"
+
+#include <QX11Info>
+#include <X11/Xatom.h>
+#include <xcb/xcbext.h>
+#include <stdlib.h>
+
+// Don't record more of a property (in 32-bit units).
+static const long MaxPropertyLength = 64 * 1024;
+
+MEventRecorder::MEventRecorder(const QString &fname, int damage_event,
+                               int shape_event)
+    : dpy(QX11Info::display()), xcb(XGetXCBConnection(dpy)), file(fname)
+{
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("MEventRecorder: couldn't open %s",
+                 fname.toLatin1().constData());
+        return;
+    }
+    out.setDevice(&file);
+    clock.start();
+    net_wm_state = XInternAtom(dpy, "_NET_WM_STATE", False);
+    wm_protocols = XInternAtom(dpy, "WM_PROTOCOLS", False);
+
+    Window root = DefaultRootWindow(dpy);
+    out.writeRawData("MCTRACE", 7);
+    out << quint32(Version) << quint16(damage_event) << quint16(shape_event)
+        << quint16(sizeof(XEvent))
+        << quint16(DisplayWidth(dpy, DefaultScreen(dpy)))
+        << quint16(DisplayHeight(dpy, DefaultScreen(dpy)));
+
+    // Snapshot the current windows, bottom first.
+    Window r, p, *children = 0;
+    unsigned n = 0;
+    if (XQueryTree(dpy, root, &r, &p, &children, &n)) {
+        for (unsigned i = 0; i < n; ++i) {
+            properties(0, children[i]);
+            window(0, children[i], root);
+        }
+        if (children)
+            XFree(children);
+    }
+    xcb_flush(xcb);
+}
+
+MEventRecorder::~MEventRecorder()
+{
+    flush(true);
+}
+
+void MEventRecorder::begin(quint32 time, Record type)
+{
+    out << time << quint8(type);
+}
+
+MEventRecorder::Pending MEventRecorder::atomName(quint32 time, Atom a)
+{
+    Pending p(Pending::AtomName, time);
+    p.atom = a;
+    p.seq = xcb_get_atom_name(xcb, a).sequence;
+    return p;
+}
+
+void MEventRecorder::atom(quint32 time, Atom a)
+{
+    if (a == None || atoms.contains(a))
+        return;
+    atoms.insert(a);
+    pending.append(atomName(time, a));
+}
+
+void MEventRecorder::window(quint32 time, Window w, Window parent)
+{
+    Pending p(Pending::Attributes, time);
+    p.window = w;
+    p.parent = parent;
+    p.seq = xcb_get_window_attributes(xcb, w).sequence;
+    p.seq2 = xcb_get_geometry(xcb, w).sequence;
+    pending.append(p);
+}
+
+MEventRecorder::Pending MEventRecorder::property(quint32 time, Window w,
+                                                 Atom prop)
+{
+    Pending p(Pending::PropertyValue, time);
+    p.window = w;
+    p.atom = prop;
+    p.seq = xcb_get_property(xcb, 0, w, prop, XCB_GET_PROPERTY_TYPE_ANY,
+                             0, MaxPropertyLength).sequence;
+    return p;
+}
+
+void MEventRecorder::properties(quint32 time, Window w)
+{
+    Pending p(Pending::PropertyList, time);
+    p.window = w;
+    p.seq = xcb_list_properties(xcb, w).sequence;
+    pending.append(p);
+}
+
+// Takes the reply to @seq if it has arrived or if we may @wait for it.
+// *r is NULL if the request failed.
+bool MEventRecorder::reply(unsigned seq, bool wait, void **r)
+{
+    xcb_generic_error_t *error = 0;
+
+    *r = 0;
+    if (wait)
+        *r = xcb_wait_for_reply(xcb, seq, &error);
+    else if (!xcb_poll_for_reply(xcb, seq, r, &error))
+        return false;
+    if (error)
+        free(error);
+    return true;
+}
+
+// Writes the queued records up to the first one whose reply is still
+// outstanding, or all of them if we can @wait.
+void MEventRecorder::flush(bool wait)
+{
+    while (!pending.isEmpty()) {
+        if (!isOpen()) {
+            discard();
+            return;
+        }
+
+        const Pending p = pending.first();
+        void *r = 0, *r2 = 0;
+        switch (p.kind) {
+        case Pending::Data:
+            out.writeRawData(p.data.constData(), p.data.size());
+            break;
+        case Pending::AtomName:
+            if (!reply(p.seq, wait, &r))
+                return;
+            if (r) {
+                xcb_get_atom_name_reply_t *n =
+                    static_cast<xcb_get_atom_name_reply_t *>(r);
+                begin(p.time, AtomRecord);
+                out << quint32(p.atom)
+                    << QByteArray(xcb_get_atom_name_name(n),
+                                  xcb_get_atom_name_name_length(n));
+            }
+            break;
+        case Pending::Attributes:
+            // The geometry was asked for later, so once it's here
+            // the attributes are too.
+            if (!reply(p.seq2, wait, &r2))
+                return;
+            reply(p.seq, true, &r);
+            if (r && r2) {
+                xcb_get_window_attributes_reply_t *a =
+                    static_cast<xcb_get_window_attributes_reply_t *>(r);
+                xcb_get_geometry_reply_t *g =
+                    static_cast<xcb_get_geometry_reply_t *>(r2);
+                begin(p.time, WindowRecord);
+                out << quint32(p.window) << quint32(p.parent)
+                    << qint16(g->x) << qint16(g->y)
+                    << quint16(g->width) << quint16(g->height)
+                    << quint16(g->border_width)
+                    << quint8(a->override_redirect)
+                    << quint8(a->_class == XCB_WINDOW_CLASS_INPUT_ONLY)
+                    << quint8(a->map_state == XCB_MAP_STATE_VIEWABLE);
+            }
+            break;
+        case Pending::PropertyList:
+            if (!reply(p.seq, wait, &r))
+                return;
+            pending.removeFirst();
+            if (r) {
+                xcb_list_properties_reply_t *l =
+                    static_cast<xcb_list_properties_reply_t *>(r);
+                xcb_atom_t *props = xcb_list_properties_atoms(l);
+                for (int i = xcb_list_properties_atoms_length(l); i > 0; --i)
+                    pending.prepend(property(p.time, p.window, props[i-1]));
+                free(r);
+                xcb_flush(xcb);
+            }
+            continue;
+        case Pending::PropertyValue: {
+            if (!reply(p.seq, wait, &r))
+                return;
+            pending.removeFirst();
+            if (!r)
+                continue;
+
+            xcb_get_property_reply_t *v =
+                static_cast<xcb_get_property_reply_t *>(r);
+            unsigned nitems = v->value_len;
+            const void *data = xcb_get_property_value(v);
+
+            Pending rec(Pending::Data, p.time);
+            QDataStream s(&rec.data, QIODevice::WriteOnly);
+            s.setVersion(out.version());
+            s << p.time << quint8(PropertyRecord)
+              << quint32(p.window) << quint32(p.atom) << quint32(v->type)
+              << quint8(v->type != None ? v->format : 0) << quint32(nitems);
+            for (unsigned i = 0; v->type != None && i < nitems; ++i)
+                switch (v->format) {
+                case 8:  s << ((const quint8 *)data)[i];  break;
+                case 16: s << ((const quint16 *)data)[i]; break;
+                case 32: s << ((const quint32 *)data)[i]; break;
+                }
+            pending.prepend(rec);
+
+            // Name the atoms in the value first.
+            QList<Atom> names;
+            names << p.atom << v->type;
+            if (v->type == XA_ATOM && v->format == 32)
+                for (unsigned i = 0; i < nitems; ++i)
+                    names << ((const quint32 *)data)[i];
+            for (int i = names.count() - 1; i >= 0; --i)
+                if (names[i] != None && !atoms.contains(names[i])) {
+                    atoms.insert(names[i]);
+                    pending.prepend(atomName(p.time, names[i]));
+                }
+            free(r);
+            xcb_flush(xcb);
+            continue;
+        }
+        }
+        pending.removeFirst();
+        free(r);
+        free(r2);
+
+        if (out.status() != QDataStream::Ok) {
+            qWarning("MEventRecorder: write error, stopped recording");
+            file.close();
+        }
+    }
+}
+
+// Drops the queued records and the replies they were waiting for.
+void MEventRecorder::discard()
+{
+    foreach (const Pending &p, pending) {
+        if (p.seq)
+            xcb_discard_reply(xcb, p.seq);
+        if (p.seq2)
+            xcb_discard_reply(xcb, p.seq2);
+    }
+    pending.clear();
+}
+
+void MEventRecorder::event(const XEvent *e)
+{
+    if (!isOpen())
+        return;
+
+    quint32 now = clock.elapsed();
+    switch (e->type) {
+    case CreateNotify:
+        properties(now, e->xcreatewindow.window);
+        break;
+    case MapRequest:
+        properties(now, e->xmaprequest.window);
+        break;
+    case PropertyNotify:
+        atom(now, e->xproperty.atom);
+        break;
+    case ClientMessage:
+        atom(now, e->xclient.message_type);
+        // The data is only known to be atoms for these.
+        if (e->xclient.message_type == net_wm_state) {
+            atom(now, e->xclient.data.l[1]);
+            atom(now, e->xclient.data.l[2]);
+        } else if (e->xclient.message_type == wm_protocols)
+            atom(now, e->xclient.data.l[0]);
+        break;
+    }
+
+    Pending ev(Pending::Data, now);
+    QDataStream s(&ev.data, QIODevice::WriteOnly);
+    s.setVersion(out.version());
+    s << now << quint8(EventRecord) << quint16(sizeof(*e));
+    s.writeRawData(reinterpret_cast<const char *>(e), sizeof(*e));
+    pending.append(ev);
+
+    // What the stand-in windows need to look like.
+    if (e->type == CreateNotify)
+        window(now, e->xcreatewindow.window, e->xcreatewindow.parent);
+    else if (e->type == PropertyNotify
+             && e->xproperty.state == PropertyNewValue)
+        pending.append(property(now, e->xproperty.window,
+                                e->xproperty.atom));
+    else if (e->type == PropertyNotify) {
+        Pending del(Pending::Data, now);
+        QDataStream s(&del.data, QIODevice::WriteOnly);
+        s.setVersion(out.version());
+        s << now << quint8(PropertyRecord)
+          << quint32(e->xproperty.window) << quint32(e->xproperty.atom)
+          << quint32(None) << quint8(0) << quint32(0);
+        pending.append(del);
+    }
+
+    xcb_flush(xcb);
+    flush(false);
+}
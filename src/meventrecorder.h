@@ -0,0 +1,124 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MEVENTRECORDER_H
+#define MEVENTRECORDER_H
+
+#include <QFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QList>
+#include <X11/Xlib-xcb.h>
+
+/*!
+ * Records the X events the compositor sees into a trace file, which
+ * tests/replay/mcreplay can play back against stand-in windows.
+ *
+ * The trace is a QDataStream of a header:
+ *   "MCTRACE", quint32 version, quint16 DamageNotify event number,
+ *   quint16 ShapeNotify event number, quint16 sizeof(XEvent),
+ *   quint16 root width and height
+ * followed by records starting with a quint32 time in ms and a quint8
+ * Record type:
+ *   EventRecord:    quint16 size, the XEvent as it is in memory
+ *   WindowRecord:   quint32 window, parent, qint16 x, y, quint16 width,
+ *                   height, border, quint8 override_redirect, input_only,
+ *                   viewable
+ *   PropertyRecord: quint32 window, property, type, quint8 format
+ *                   (0 if the property was deleted), quint32 nitems and
+ *                   nitems * format bits of data
+ *   AtomRecord:     quint32 atom, QByteArray name
+ * Atoms are named by an AtomRecord before they are first used.  The new
+ * value of a property follows its PropertyNotify, and the properties of
+ * a window precede its MapRequest.  The raw XEvents make the trace only
+ * replayable on the architecture it was recorded on.
+ *
+ * Recording must not stall the event filter, so the window attributes,
+ * properties and atom names are requested asynchronously and the records
+ * are queued in order until their replies arrive.  They are stamped with
+ * the time of the event, but the values are read when the server gets to
+ * the requests, which may be a little later.
+ *
+ * Replay is not deterministic.  The trace only has the inputs, and the
+ * compositor runs on its own clock while they are replayed in (scaled)
+ * wall-clock time, so its timers (animations, ping and splash timeouts,
+ * the grab delay) may fire at different points of the trace from run
+ * to run.  It's good for reproducing scenarios and benchmarking, not for
+ * comparing the resulting states exactly.
+ */
+class MEventRecorder
+{
+public:
+    enum { Version = 1 };
+    enum Record {
+        EventRecord = 1,
+        WindowRecord,
+        PropertyRecord,
+        AtomRecord
+    };
+
+    // Start recording into @fname with the current windows.  The event
+    // numbers are of DamageNotify and ShapeNotify.
+    MEventRecorder(const QString &fname, int damage_event, int shape_event);
+    // Writes out the records still waiting for replies.
+    ~MEventRecorder();
+
+    bool isOpen() const { return file.isOpen(); }
+    void event(const XEvent *e);
+
+private:
+    // A record waiting to be written.  Data records are complete,
+    // the others wait for the reply to request @seq (and @seq2).
+    struct Pending {
+        enum Kind { Data, AtomName, Attributes, PropertyList, PropertyValue };
+
+        Pending(Kind k, quint32 t)
+            : kind(k), time(t), seq(0), seq2(0),
+              window(None), parent(None), atom(None) {}
+
+        Kind kind;
+        quint32 time;
+        unsigned seq, seq2;
+        Window window, parent;
+        Atom atom;
+        QByteArray data;
+    };
+
+    void begin(quint32 time, Record type);
+    Pending atomName(quint32 time, Atom a);
+    void atom(quint32 time, Atom a);
+    void window(quint32 time, Window w, Window parent);
+    Pending property(quint32 time, Window w, Atom prop);
+    void properties(quint32 time, Window w);
+    bool reply(unsigned seq, bool wait, void **r);
+    void flush(bool wait);
+    void discard();
+
+    Display *dpy;
+    xcb_connection_t *xcb;
+    QList<Pending> pending;
+    QFile file;
+    QDataStream out;
+    QElapsedTimer clock;
+    QSet<Atom> atoms;
+    Atom net_wm_state, wm_protocols;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mjsonwriter.h"
+
+#include <QIODevice>
+#include <QString>
+#include <QRect>
+#include <QByteArray>
+#include <qnumeric.h>
+
+#include <stdio.h>
+#include <string.h>
+
+MJsonWriter::MJsonWriter(QIODevice *out)
+    : out(out)
+{
+}
+
+void MJsonWriter::write(const char *str, int len)
+{
+    out->write(str, len < 0 ? strlen(str) : len);
+}
+
+// Separate from the previous member and write the name of this one.
+void MJsonWriter::member(const char *key)
+{
+    if (!empty.isEmpty()) {
+        if (!empty.last())
+            write(",");
+        empty.last() = false;
+    }
+    if (key) {
+        quote(key);
+        write(":");
+    }
+}
+
+void MJsonWriter::beginObject(const char *key)
+{
+    member(key);
+    write("{");
+    empty.append(true);
+}
+
+void MJsonWriter::endObject()
+{
+    empty.pop_back();
+    write("}");
+    if (empty.isEmpty())
+        write("\n");
+}
+
+void MJsonWriter::beginArray(const char *key)
+{
+    member(key);
+    write("[");
+    empty.append(true);
+}
+
+void MJsonWriter::endArray()
+{
+    empty.pop_back();
+    write("]");
+}
+
+void MJsonWriter::number(const char *key, qint64 n)
+{
+    char buf[24];
+    member(key);
+    write(buf, snprintf(buf, sizeof(buf), "%lld", (long long)n));
+}
+
+void MJsonWriter::real(const char *key, double n)
+{
+    member(key);
+    if (!qIsFinite(n)) {
+        // JSON has no NaN or infinity.
+        write("null");
+        return;
+    }
+    // Not printf(), which would use the decimal comma of the locale.
+    const QByteArray buf = QByteArray::number(n, 'g', 6);
+    write(buf.constData(), buf.size());
+}
+
+void MJsonWriter::boolean(const char *key, bool b)
+{
+    member(key);
+    write(b ? "true" : "false");
+}
+
+void MJsonWriter::string(const char *key, const char *str)
+{
+    member(key);
+    if (str)
+        quote(str);
+    else
+        write("null");
+}
+
+void MJsonWriter::quote(const char *str)
+{
+    write("\"");
+    for (const char *s = str; *s; ) {
+        // Write the longest run which doesn't need escaping at once.
+        int n = strcspn(s, "\"\\\b\f\n\r\t\x01\x02\x03\x04\x05\x06\x07"
+                        "\x0b\x0e\x0f\x10\x11\x12\x13\x14\x15\x16\x17"
+                        "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f");
+        write(s, n);
+        s += n;
+        if (!*s)
+            break;
+
+        char esc[8];
+        switch (*s) {
+        case '"':  write("\\\"");  break;
+        case '\\': write("\\\\");  break;
+        case '\n': write("\\n");   break;
+        case '\t': write("\\t");   break;
+        default:
+            write(esc, snprintf(esc, sizeof(esc), "\\u%04x", *s));
+            break;
+        }
+        s++;
+    }
+    write("\"");
+}
+
+void MJsonWriter::string(const char *key, const QString &str)
+{
+    string(key, str.toUtf8().constData());
+}
+
+void MJsonWriter::rect(const char *key, const QRect &r)
+{
+    beginArray(key);
+    number(0, r.x());
+    number(0, r.y());
+    number(0, r.width());
+    number(0, r.height());
+    endArray();
+}
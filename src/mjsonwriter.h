@@ -0,0 +1,63 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MJSONWRITER_H
+#define MJSONWRITER_H
+
+#include <QVector>
+
+class QIODevice;
+class QString;
+class QRect;
+
+/*!
+ * Streams JSON to a QIODevice as it's generated, without building a
+ * document in memory.  @key is the name of the member in objects,
+ * and it must be NULL for array elements.
+ */
+class MJsonWriter
+{
+public:
+    MJsonWriter(QIODevice *out);
+
+    void beginObject(const char *key = 0);
+    void endObject();
+    void beginArray(const char *key = 0);
+    void endArray();
+
+    void number(const char *key, qint64 n);
+    void real(const char *key, double n);
+    void boolean(const char *key, bool b);
+    // NULL @str is written as null.
+    void string(const char *key, const char *str);
+    void string(const char *key, const QString &str);
+    // [x, y, width, height]
+    void rect(const char *key, const QRect &r);
+
+private:
+    void member(const char *key);
+    void quote(const char *str);
+    void write(const char *str, int len = -1);
+
+    QIODevice *out;
+    // Whether the innermost object or array is still empty.
+    QVector<bool> empty;
+};
+
+#endif
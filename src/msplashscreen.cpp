@@ -121,7 +121,7 @@ MSplashScreen::MSplashScreen(unsigned int splash_pid,
 
     if (pixmap) {
         timer.setSingleShot(true);
-        timer.setInterval(m->configInt("splash-timeout-ms"));
+        timer.setInterval(m->cfg().splash_timeout_ms);
         connect(&timer, SIGNAL(timeout()), m->d, SLOT(splashTimeout()));
         timer.start();
     }
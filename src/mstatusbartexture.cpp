@@ -151,7 +151,7 @@ bool MStatusBarTexture::updateStatusBarGeometry()
         // Couldn't determine the size from the desktop window,
         // assume some probable defaults.
         lscape = QSize(pixmap.width(),
-            ((MCompositeManager*)qApp)->configInt("default-statusbar-height"));
+            ((MCompositeManager*)qApp)->cfg().default_statusbar_height);
     if (portrait.isEmpty())
         // Assume full-width portrait statusbar.
         portrait = QSize(QApplication::desktop()->height(), lscape.height());
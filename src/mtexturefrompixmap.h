@@ -48,6 +48,12 @@ public:
      * Update texture content if using fallback implementation without TFP
      */
     void update();
+    /*!
+     * Returns whether update() copies the contents of the pixmap to the
+     * texture.  Otherwise the texture shows the live contents of the
+     * pixmap, and they can't be held back by skipping update().
+     */
+    static bool copiesContents();
 
     /*!
      * Query if texture is inverted
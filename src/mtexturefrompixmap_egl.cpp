@@ -91,6 +91,11 @@ bool MTextureFromPixmap::invertedTexture() const
     return false;
 }
 
+bool MTextureFromPixmap::copiesContents()
+{
+    return !EglResourceManager::texturePixmapSupport();
+}
+
 void MTextureFromPixmap::update()
 {
     if (EglResourceManager::texturePixmapSupport())
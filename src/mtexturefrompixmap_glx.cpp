@@ -152,6 +152,11 @@ bool MTextureFromPixmap::invertedTexture() const
         return false;
 }
 
+bool MTextureFromPixmap::copiesContents()
+{
+    return !hasTextureFromPixmap();
+}
+
 void MTextureFromPixmap::update()
 {
     if (hasTextureFromPixmap() || !drawable)
@@ -90,6 +90,13 @@ public:
     void enableDirectFbRendering();
     void enableRedirectedRendering();
 
+    /*!
+     * Paints the window from a copy of its current contents until
+     * thawContents(), so that the client can go on drawing meanwhile.
+     */
+    void freezeContents();
+    void thawContents();
+
     virtual Pixmap windowPixmap() const { return d->TFP.drawable; }
 
 protected:
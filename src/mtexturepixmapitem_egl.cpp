@@ -176,6 +176,14 @@ void MTexturePixmapItem::updateWindowPixmap(XRectangle *rects, int num,
     const unsigned expiry = 1000;
     const int      limit  =   30;
 
+    MCompositeManager *m = (MCompositeManager*)qApp;
+    if (m->servergrab.contentsFrozen()) {
+        // Keep showing what we had when the transition started.
+        propertyCache()->damageSubtract();
+        m->servergrab.deferDamage(window());
+        return;
+    }
+
     if (hasTransitioningWindow()) {
 
         if (!windowAnimator()->isManuallyUpdated() &&
@@ -241,13 +249,16 @@ void MTexturePixmapItem::updateWindowPixmap(XRectangle *rects, int num,
         saveBackingStore();
     
     if (!d->damageRegion.isEmpty()) {
-        d->TFP.update();
-        MCompositeManager *m = (MCompositeManager*)qApp;
+        // if it's been resized the contents are taken with the new pixmap
+        if (!d->pixmap_stale)
+            d->TFP.update();
+        d->invalidateBlurCache();
         if (!m->disableRedrawingDueToDamage()) {
             if (!d->current_window_group) 
                 d->glwidget->update();
             else
-                d->current_window_group->updateWindowPixmap();
+                d->current_window_group->memberDamaged(this,
+                                                       d->damageRegion);
         }
     }
     propertyCache()->damageSubtract();
@@ -19,6 +19,7 @@
 
 #include "mtexturepixmapitem.h"
 #include "mtexturepixmapitem_p.h"
+#include "mcompositemanager.h"
 
 #include <QPainterPath>
 #include <QRect>
@@ -137,7 +138,17 @@ void MTexturePixmapItem::updateWindowPixmap(XRectangle *rects, int num,
         || propertyCache()->isInputOnly())
         return;
 
+    MCompositeManager *m = (MCompositeManager*)qApp;
+    if (m->servergrab.contentsFrozen()) {
+        propertyCache()->damageSubtract();
+        m->servergrab.deferDamage(window());
+        return;
+    }
+
     propertyCache()->damageSubtract();
-    d->TFP.update();
+    // if it's been resized the contents are taken with the new pixmap
+    if (!d->pixmap_stale)
+        d->TFP.update();
+    d->invalidateBlurCache();
     update();
 }
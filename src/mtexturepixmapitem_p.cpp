@@ -27,11 +27,15 @@
 
 #include <QX11Info>
 #include <QRect>
+#include <QDir>
+#include <QFile>
+#include <QCryptographicHash>
 
 #include <X11/Xlib.h>
 #include <X11/extensions/Xcomposite.h>
 #include <X11/extensions/Xrender.h>
 #ifdef GLES2_VERSION
+#include "mcompositewindowgroup.h"
 #include <GLES2/gl2.h>
 #elif DESKTOP_VERSION
 #include <GL/gl.h>
@@ -64,13 +68,14 @@ public:
         texture = -1;
         opacity = -1;
         blurstep = -1;
+        has_opacity = true;
+        has_matrix = false;
     }
     void setWorldMatrix(GLfloat m[4][4]) {
-        static bool init = true;
-        if (init || memcmp(m, worldMatrix, sizeof(worldMatrix))) {
+        if (!has_matrix || memcmp(m, worldMatrix, sizeof(worldMatrix))) {
             setUniformValue("matWorld", m);
             memcpy(worldMatrix, m, sizeof(worldMatrix));
-            init = false;
+            has_matrix = true;
         }
     }
 
@@ -81,8 +86,11 @@ public:
         }
     }
 
+    // for programs without the opacity uniform
+    void setHasOpacity(bool h) { has_opacity = h; }
+
     void setOpacity(GLfloat o) {
-        if (o != opacity) {
+        if (has_opacity && o != opacity) {
             setUniformValue("opacity", o);
             opacity = o;
         }
@@ -95,13 +103,155 @@ public:
     }
 
 private:
-    // static because this is set in the shared vertex shader
-    static GLfloat worldMatrix[4][4];
+    // The vertex shader is shared, but uniforms are per program.
+    GLfloat worldMatrix[4][4];
     GLfloat opacity, blurstep;
     GLuint texture;
+    bool has_opacity, has_matrix;
 };
 
-GLfloat MShaderProgram::worldMatrix[4][4];
+// Blurred copy of a window's texture, kept until the window is damaged.
+class MBlurCache
+{
+public:
+    MBlurCache() : radius(0), passes(0), valid(false) {}
+    ~MBlurCache() { qDeleteAll(levels); }
+
+    QList<QGLFramebufferObject *> levels;
+    QSize size;
+    qreal radius;
+    int passes;
+    bool valid;
+};
+
+#ifndef GL_PROGRAM_BINARY_LENGTH_OES
+#define GL_PROGRAM_BINARY_LENGTH_OES 0x8741
+#endif
+
+/*
+ * Persistent cache of linked shader program binaries.  Compiling and
+ * linking GLSL is expensive on the device, so if the driver supports
+ * GL_OES_get_program_binary (or GL_ARB_get_program_binary on desktop)
+ * we store the linked programs under ~/.cache/mcompositor and load them
+ * back on the next start.  Binaries are keyed by the shader sources and
+ * the GL vendor/renderer/version strings, so a driver update simply
+ * results in cache misses.
+ */
+class MShaderBinaryCache
+{
+public:
+    MShaderBinaryCache(const QGLContext *glcontext)
+        : getProgramBinary(0), programBinary(0)
+    {
+        if (!((MCompositeManager*)qApp)->cfg().shader_binary_cache)
+            return;
+
+        const QByteArray exts((const char *)glGetString(GL_EXTENSIONS));
+        QGLContext *ctx = const_cast<QGLContext *>(glcontext);
+        if (exts.contains("GL_OES_get_program_binary")) {
+            getProgramBinary = (GetProgramBinaryFunc)
+                ctx->getProcAddress("glGetProgramBinaryOES");
+            programBinary = (ProgramBinaryFunc)
+                ctx->getProcAddress("glProgramBinaryOES");
+        } else if (exts.contains("GL_ARB_get_program_binary")) {
+            getProgramBinary = (GetProgramBinaryFunc)
+                ctx->getProcAddress("glGetProgramBinary");
+            programBinary = (ProgramBinaryFunc)
+                ctx->getProcAddress("glProgramBinary");
+        }
+        if (!getProgramBinary || !programBinary) {
+            getProgramBinary = 0;
+            programBinary = 0;
+            return;
+        }
+
+        driver = QByteArray((const char *)glGetString(GL_VENDOR)) + '\n'
+               + QByteArray((const char *)glGetString(GL_RENDERER)) + '\n'
+               + QByteArray((const char *)glGetString(GL_VERSION)) + '\n';
+        dir = QDir::homePath() + "/.cache/mcompositor/shaders";
+        if (!QDir().mkpath(dir)) {
+            qWarning("%s: can't create %s", __func__, dir.toLatin1().constData());
+            getProgramBinary = 0;
+            programBinary = 0;
+        }
+    }
+
+    bool isEnabled() const { return programBinary != 0; }
+
+    QString fileName(const char *vertex, const QByteArray &fragment) const
+    {
+        QCryptographicHash h(QCryptographicHash::Md5);
+        h.addData(driver);
+        h.addData(vertex);
+        h.addData(fragment);
+        return dir + '/' + h.result().toHex();
+    }
+
+    // Try to fill the (unlinked, shaderless) @p with a cached binary.
+    bool load(QGLShaderProgram *p, const QString &fn)
+    {
+        QFile f(fn);
+        if (!f.open(QIODevice::ReadOnly))
+            return false;
+        QByteArray data = f.readAll();
+        f.close();
+        if (data.size() <= (int)sizeof(GLenum)) {
+            QFile::remove(fn);
+            return false;
+        }
+
+        GLenum format;
+        memcpy(&format, data.constData(), sizeof(format));
+        programBinary(p->programId(), format, data.constData() + sizeof(format),
+                      data.size() - sizeof(format));
+        // QGLShaderProgram::link() without shaders only checks the status
+        if (p->link())
+            return true;
+
+        // stale or corrupted, the caller will compile from source
+        QFile::remove(fn);
+        return false;
+    }
+
+    void save(QGLShaderProgram *p, const QString &fn)
+    {
+        GLint len = 0;
+        glGetProgramiv(p->programId(), GL_PROGRAM_BINARY_LENGTH_OES, &len);
+        if (len <= 0)
+            return;
+
+        QByteArray data(sizeof(GLenum) + len, 0);
+        GLenum format = 0;
+        getProgramBinary(p->programId(), len, &len, &format,
+                         data.data() + sizeof(format));
+        memcpy(data.data(), &format, sizeof(format));
+        data.truncate(sizeof(format) + len);
+
+        // write atomically so a crash can't leave a truncated binary behind
+        QFile f(fn + ".tmp");
+        if (!f.open(QIODevice::WriteOnly)
+            || f.write(data) != data.size()) {
+            qWarning("%s: can't write %s", __func__,
+                     f.fileName().toLatin1().constData());
+            f.remove();
+            return;
+        }
+        f.close();
+        QFile::remove(fn);
+        f.rename(fn);
+    }
+
+private:
+    typedef void (*GetProgramBinaryFunc)(GLuint program, GLsizei bufSize,
+                                         GLsizei *length, GLenum *format,
+                                         GLvoid *binary);
+    typedef void (*ProgramBinaryFunc)(GLuint program, GLenum format,
+                                      const GLvoid *binary, GLint length);
+    GetProgramBinaryFunc getProgramBinary;
+    ProgramBinaryFunc programBinary;
+    QByteArray driver;
+    QString dir;
+};
 
 // OpenGL ES 2.0 / OpenGL 2.0 - compatible texture painter
 class MGLResourceManager: public QObject
@@ -114,43 +264,74 @@ public:
      */
     enum ShaderType {
         NormalShader = 0,
-        BlurShader,
+        OpaqueShader,
+        BlurDownShader,
+        BlurUpShader,
         ShaderTotal
     };
 
+    /*
+     * The variant of the normal shader to draw with at @opacity.
+     * Blending is set up by the caller, so windows with alpha can be
+     * drawn with the opaque variant as long as they are not faded.
+     */
+    static ShaderType shaderFor(qreal opacity)
+    {
+        return opacity < 1.0 ? NormalShader : OpaqueShader;
+    }
+
     MGLResourceManager(QGLWidget *glwidget)
         : QObject(glwidget),
           glcontext(glwidget->context()),
+          sharedVertexShader(0),
+          binaryCache(glwidget->context()),
+          warmupTimer(0),
           currentShader(0)
     {
-        sharedVertexShader = new QGLShader(QGLShader::Vertex,
-                glwidget->context(), this);
-        if (!sharedVertexShader->compileSourceCode(QLatin1String(TexpVertShaderSource)))
-            qWarning("vertex shader failed to compile");
-
-        MShaderProgram *normalShader = new MShaderProgram(glwidget->context(),
-                                                          this);
-        normalShader->addShader(sharedVertexShader);
-        if (!normalShader->addShaderFromSourceCode(QGLShader::Fragment,
-                QLatin1String(TexpFragShaderSource)))
+        shader[NormalShader] = createProgram(TexpFragShaderSource);
+        if (!shader[NormalShader]->isLinked())
             qWarning("normal fragment shader failed to compile");
-        shader[NormalShader] = normalShader;
-
-        MShaderProgram *blurShader = new MShaderProgram(glwidget->context(),
-                                                        this);
-        shader[BlurShader] = blurShader;
-        blurShader->addShader(sharedVertexShader);
-        if (!blurShader->addShaderFromSourceCode(QGLShader::Fragment,
-                QLatin1String(blurshader)))
+        shader[OpaqueShader] = createProgram(TexpOpaqueFragShaderSource);
+        shader[OpaqueShader]->setHasOpacity(false);
+        if (!shader[OpaqueShader]->isLinked())
+            qWarning("opaque fragment shader failed to compile");
+        shader[BlurDownShader] = createProgram(blurdownshader);
+        shader[BlurUpShader] = createProgram(blurupshader);
+        if (!shader[BlurDownShader]->isLinked()
+            || !shader[BlurUpShader]->isLinked())
             qWarning("blur fragment shader failed to compile");
+    }
 
-        bindAttribLocation(normalShader, "inputVertex", D_VERTEX_COORDS);
-        bindAttribLocation(normalShader, "textureCoord", D_TEXTURE_COORDS);
-        bindAttribLocation(blurShader, "inputVertex", D_VERTEX_COORDS);
-        bindAttribLocation(blurShader, "textureCoord", D_TEXTURE_COORDS);
+    /*
+     * Returns a program made of the shared vertex shader and @fragment,
+     * preferably loaded from the binary cache.  Check isLinked().
+     */
+    MShaderProgram *createProgram(const QByteArray &fragment)
+    {
+        QString cached;
+        if (binaryCache.isEnabled()) {
+            cached = binaryCache.fileName(TexpVertShaderSource, fragment);
+            MShaderProgram *p = new MShaderProgram(glcontext, this);
+            if (binaryCache.load(p, cached))
+                return p;
+            delete p;
+        }
 
-        normalShader->link();
-        blurShader->link();
+        if (!sharedVertexShader) {
+            sharedVertexShader = new QGLShader(QGLShader::Vertex,
+                                               glcontext, this);
+            if (!sharedVertexShader->compileSourceCode(QLatin1String(TexpVertShaderSource)))
+                qWarning("vertex shader failed to compile");
+        }
+
+        MShaderProgram *p = new MShaderProgram(glcontext, this);
+        p->addShader(sharedVertexShader);
+        p->addShaderFromSourceCode(QGLShader::Fragment, QLatin1String(fragment));
+        bindAttribLocation(p, "inputVertex", D_VERTEX_COORDS);
+        bindAttribLocation(p, "textureCoord", D_TEXTURE_COORDS);
+        if (p->link() && !cached.isEmpty())
+            binaryCache.save(p, cached);
+        return p;
     }
 
     void initVertices(QGLWidget *glwidget) {
@@ -187,6 +368,94 @@ public:
             shader[i]->bind();
             shader[i]->setUniformValue("matProj", projMatrix);
         }
+
+        // blur passes draw a quad given in normalized device coordinates
+        GLfloat identity[4][4];
+        memset(identity, 0, sizeof(identity));
+        for (int i = 0; i < 4; i++)
+            identity[i][i] = 1.0;
+        for (int i = BlurDownShader; i <= BlurUpShader; i++) {
+            shader[i]->bind();
+            shader[i]->setUniformValue("matProj", identity);
+            shader[i]->setUniformValue("matWorld", identity);
+        }
+    }
+
+    /*
+     * Blurs the texture @source of @size into @cache with @passes
+     * downsampling steps, reusing the FBOs in the cache if possible.
+     * The result is in the first level of @cache.
+     */
+    void blur(MBlurCache *cache, GLuint source, const QSize &size,
+              qreal radius, int passes, bool inverted)
+    {
+        if (cache->size != size || cache->levels.size() != passes) {
+            qDeleteAll(cache->levels);
+            cache->levels.clear();
+            QSize s = size;
+            for (int i = 0; i < passes; ++i) {
+                s = QSize(qMax(s.width() / 2, 1), qMax(s.height() / 2, 1));
+                QGLFramebufferObject *fbo = new QGLFramebufferObject(s);
+                // the filter relies on bilinear sampling between texels
+                glBindTexture(GL_TEXTURE_2D, fbo->texture());
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                cache->levels.append(fbo);
+            }
+            cache->size = size;
+        }
+
+        GLint fbo, viewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean scissor_on = glIsEnabled(GL_SCISSOR_TEST);
+        GLboolean blend_on = glIsEnabled(GL_BLEND);
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_BLEND);
+
+        static const GLfloat quad[] = { -1, 1, -1, -1, 1, -1, 1, 1 };
+        glEnableVertexAttribArray(D_VERTEX_COORDS);
+        glEnableVertexAttribArray(D_TEXTURE_COORDS);
+        glVertexAttribPointer(D_VERTEX_COORDS, 2, GL_FLOAT, GL_FALSE, 0, quad);
+
+        blurPass(BlurDownShader, source, cache->levels[0], radius,
+                 inverted ? texCoordsInv : texCoords);
+        for (int i = 1; i < passes; ++i)
+            blurPass(BlurDownShader, cache->levels[i - 1]->texture(),
+                     cache->levels[i], radius, texCoords);
+        for (int i = passes - 2; i >= 0; --i)
+            blurPass(BlurUpShader, cache->levels[i + 1]->texture(),
+                     cache->levels[i], radius, texCoords);
+
+        glDisableVertexAttribArray(D_VERTEX_COORDS);
+        glDisableVertexAttribArray(D_TEXTURE_COORDS);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (scissor_on)
+            glEnable(GL_SCISSOR_TEST);
+        if (blend_on)
+            glEnable(GL_BLEND);
+
+        cache->radius = radius;
+        cache->passes = passes;
+        cache->valid = true;
+    }
+
+    void blurPass(ShaderType type, GLuint source, QGLFramebufferObject *target,
+                  qreal radius, const GLfloat *coords)
+    {
+        MShaderProgram *p = shader[type];
+        p->bind();
+        glBindFramebuffer(GL_FRAMEBUFFER, target->handle());
+        glViewport(0, 0, target->width(), target->height());
+        glBindTexture(GL_TEXTURE_2D, source);
+        glVertexAttribPointer(D_TEXTURE_COORDS, 2, GL_FLOAT, GL_FALSE, 0,
+                              coords);
+        p->setUniformValue("halfpixel", 0.5f / target->width(),
+                           0.5f / target->height());
+        p->setBlurStep(radius);
+        p->setTexture(0);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
     }
 
     void updateVertices(const QTransform &t) 
@@ -237,34 +506,53 @@ public:
 
         QByteArray source = code;
         source.append(TexpCustomShaderSource);
-        MShaderProgram *p = new MShaderProgram(glcontext, this);
-        p->addShader(sharedVertexShader);
-        if (!p->addShaderFromSourceCode(QGLShader::Fragment,
-                QLatin1String(source)))
-            qWarning("custom fragment shader failed to compile");
+        MShaderProgram *p = createProgram(source);
+        if (!p->isLinked()) {
+            qWarning() << "failed installing custom fragment shader:"
+                       << p->log();
+            p->deleteLater();
+            return 0;
+        }
 
-        bindAttribLocation(p, "inputVertex", D_VERTEX_COORDS);
-        bindAttribLocation(p, "textureCoord", D_TEXTURE_COORDS);
+        customShadersByCode[code] = p;
+        customShadersById[p->programId()] = p;
+        return p->programId();
+    }
 
-        if (p->link()) {
-            customShadersByCode[code] = p;
-            customShadersById[p->programId()] = p;
-            return p->programId();
-        } 
-       
-        qWarning() << "failed installing custom fragment shader:"
-                   << p->log();
-        p->deleteLater();
-        
-        return 0;
+    // Queue @code to be compiled when the event loop is idle.
+    void precompilePixelShader(const QByteArray& code)
+    {
+        if (customShadersByCode.contains(code) || warmupQueue.contains(code))
+            return;
+        warmupQueue.append(code);
+        if (!warmupTimer)
+            warmupTimer = startTimer(0);
+    }
+
+protected:
+    void timerEvent(QTimerEvent *e)
+    {
+        if (e->timerId() != warmupTimer)
+            return QObject::timerEvent(e);
+
+        // one shader per iteration not to starve the event loop
+        if (!warmupQueue.isEmpty())
+            installPixelShader(warmupQueue.takeFirst());
+        if (warmupQueue.isEmpty()) {
+            killTimer(warmupTimer);
+            warmupTimer = 0;
+        }
     }
 
 private:
     static MShaderProgram *shader[ShaderTotal];
     QHash<GLuint, MShaderProgram *> customShadersById;
     QHash<QByteArray, MShaderProgram *> customShadersByCode;
-    QGLShader *sharedVertexShader;
     const QGLContext* glcontext;    
+    QGLShader *sharedVertexShader;
+    MShaderBinaryCache binaryCache;
+    QList<QByteArray> warmupQueue;
+    int warmupTimer;
     
     GLfloat projMatrix[4][4];
     GLfloat worldMatrix[4][4];
@@ -283,6 +571,7 @@ MShaderProgram *MGLResourceManager::shader[ShaderTotal];
 
 void MTexturePixmapPrivate::paint(QPainter *painter)
 {
+    renamePixmap();
     if (direct_fb_render) {
         glBindTexture(GL_TEXTURE_2D, 0);
         return;
@@ -305,6 +594,8 @@ void MTexturePixmapPrivate::paint(QPainter *painter)
 
 void MTexturePixmapPrivate::renderTexture(const QTransform& transform)
 {
+    // also here because window groups render their members directly
+    renamePixmap();
     if (item->propertyCache()->hasAlphaAndIsNotOpaque() ||
         item->opacity() < 1.0f) {
         glEnable(GL_BLEND);
@@ -318,7 +609,8 @@ void MTexturePixmapPrivate::renderTexture(const QTransform& transform)
     // eglSwapBuffersRegionNOK()
 
     bool shape_on = !QRegion(item->boundingRect().toRect()).subtracted(shape).isEmpty();
-    bool scissor_on = damageRegion.numRects() > 1 || shape_on;
+    bool clip_on = !clip_rect.isNull();
+    bool scissor_on = damageRegion.numRects() > 1 || shape_on || clip_on;
     
     if (scissor_on)
         glEnable(GL_SCISSOR_TEST);
@@ -326,27 +618,27 @@ void MTexturePixmapPrivate::renderTexture(const QTransform& transform)
     // Damage regions taking precedence over shape rects 
     if (damageRegion.numRects() > 1) {
         for (int i = 0; i < damageRegion.numRects(); ++i) {
-            glScissor(damageRegion.rects().at(i).x(),
-                      brect.height() -
-                      (damageRegion.rects().at(i).y() +
-                       damageRegion.rects().at(i).height()),
-                      damageRegion.rects().at(i).width(),
-                      damageRegion.rects().at(i).height());
+            const QRect &r = damageRegion.rects().at(i);
+            if (!scissor(QRect(r.x(), brect.height() - (r.y() + r.height()),
+                               r.width(), r.height())))
+                continue;
             drawTexture(transform, item->boundingRect(), item->opacity());        
         }
     } else if (shape_on) {
         // draw a shaped window using glScissor
         for (int i = 0; i < shape.numRects(); ++i) {
-            glScissor(shape.rects().at(i).x(),
-                      brect.height() -
-                      (shape.rects().at(i).y() +
-                       shape.rects().at(i).height()),
-                      shape.rects().at(i).width(),
-                      shape.rects().at(i).height());
+            const QRect &r = shape.rects().at(i);
+            if (!scissor(QRect(r.x(), brect.height() - (r.y() + r.height()),
+                               r.width(), r.height())))
+                continue;
             drawTexture(transform, item->boundingRect(), item->opacity());
         }
-    } else
+    } else {
+        if (clip_on)
+            glScissor(clip_rect.x(), clip_rect.y(),
+                      clip_rect.width(), clip_rect.height());
         drawTexture(transform, item->boundingRect(), item->opacity());
+    }
     
     if (scissor_on)
         glDisable(GL_SCISSOR_TEST);
@@ -362,6 +654,17 @@ void MTexturePixmapPrivate::renderTexture(const QTransform& transform)
 #endif
 }
 
+// Sets the scissor box to @r (in GL coordinates) limited to @clip_rect.
+// Returns false if nothing is left to draw.
+bool MTexturePixmapPrivate::scissor(const QRect &r) const
+{
+    const QRect s = clip_rect.isNull() ? r : r & clip_rect;
+    if (s.isEmpty())
+        return false;
+    glScissor(s.x(), s.y(), s.width(), s.height());
+    return true;
+}
+
 void MTexturePixmapPrivate::clearTexture()
 {
     glBindTexture(GL_TEXTURE_2D, TFP.textureId);
@@ -390,7 +693,8 @@ void MTexturePixmapPrivate::q_drawTexture(const QTransform &transform,
     if (current_effect)
         glresource->updateVertices(transform, current_effect->activeShaderFragment());
     else
-        glresource->updateVertices(transform, MGLResourceManager::NormalShader);
+        glresource->updateVertices(transform,
+                                   MGLResourceManager::shaderFor(opacity));
     GLfloat vertexCoords[] = {
         drawRect.left(),  drawRect.top(),
         drawRect.left(),  drawRect.bottom(),
@@ -458,6 +762,50 @@ void MTexturePixmapPrivate::q_drawTexture(const QTransform &transform,
     q_drawTexture(transform, drawRect, opacity, textureCoords);
 }
 
+GLuint MTexturePixmapPrivate::shaderProgramId() const
+{
+    if (current_effect || !glresource)
+        // effects may switch fragments and draw anywhere
+        return 0;
+    MGLResourceManager::ShaderType t;
+    t = MGLResourceManager::shaderFor(item->opacity());
+    return glresource->shader[t]->programId();
+}
+
+/*
+ * Draws a blurred version of the currently bound texture, which is
+ * only recomputed if the window has been damaged since or the blur
+ * parameters are different.
+ */
+void MTexturePixmapPrivate::drawBlurredTexture(const QTransform &transform,
+                                               const QRectF &drawRect,
+                                               qreal opacity, qreal radius,
+                                               int passes)
+{
+    GLint source;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &source);
+
+    // not brect, window groups don't have one
+    const QSize size = item->boundingRect().size().toSize();
+    passes = qBound(1, passes, 4);
+    if (!blur_cache)
+        blur_cache = new MBlurCache;
+    if (!blur_cache->valid || blur_cache->radius != radius
+        || blur_cache->passes != passes || blur_cache->size != size)
+        glresource->blur(blur_cache, source, size, radius, passes,
+                         inverted_texture);
+
+    glBindTexture(GL_TEXTURE_2D, blur_cache->levels[0]->texture());
+    q_drawTexture(transform, drawRect, opacity, glresource->texCoords);
+    glBindTexture(GL_TEXTURE_2D, source);
+}
+
+void MTexturePixmapPrivate::invalidateBlurCache()
+{
+    if (blur_cache)
+        blur_cache->valid = false;
+}
+
 void MTexturePixmapPrivate::installEffect(MCompositeWindowShaderEffect* effect)
 {
     if (effect == prev_effect)
@@ -502,6 +850,19 @@ GLuint MTexturePixmapPrivate::installPixelShader(const QByteArray& code)
     return 0;
 }
 
+void MTexturePixmapPrivate::precompilePixelShader(const QByteArray& code)
+{
+    if (!glwidget) {
+        MCompositeManager *m = (MCompositeManager*)qApp;
+        glwidget = m->glWidget();
+    }
+    if (!glresource) {
+        glresource = new MGLResourceManager(glwidget);
+        glresource->initVertices(glwidget);
+    }
+    glresource->precompilePixelShader(code);
+}
+
 void MTexturePixmapPrivate::activateEffect(bool enabled)
 {
     if (enabled)
@@ -535,7 +896,10 @@ MTexturePixmapPrivate::MTexturePixmapPrivate(Qt::HANDLE window,
       angle(0),
       item(p),
       prev_effect(0),
-      pastDamages(0)
+      pastDamages(0),
+      blur_cache(0),
+      pixmap_stale(false),
+      frozen_pixmap(None)
 {
     if (!glwidget) {
         MCompositeManager *m = (MCompositeManager*)qApp;
@@ -553,13 +917,17 @@ MTexturePixmapPrivate::~MTexturePixmapPrivate()
 
     if (TFP.drawable && !item->propertyCache()->isVirtual())
         XFreePixmap(QX11Info::display(), TFP.drawable);
+    if (frozen_pixmap)
+        XFreePixmap(QX11Info::display(), frozen_pixmap);
 
     if (pastDamages)
         delete pastDamages;
+    delete blur_cache;
 }
 
 void MTexturePixmapPrivate::saveBackingStore()
 {
+    pixmap_stale = false;
     if (item->propertyCache()->isVirtual()) {
         TFP.bind(item->windowPixmap());
         return;
@@ -577,7 +945,49 @@ void MTexturePixmapPrivate::saveBackingStore()
         return;
 
     Drawable pixmap = XCompositeNameWindowPixmap(QX11Info::display(), item->window());
-    TFP.bind(pixmap);
+    if (frozen_pixmap)
+        // bound by thawContents()
+        TFP.drawable = pixmap;
+    else
+        TFP.bind(pixmap);
+}
+
+// Bind a copy of the window pixmap to the texture.  A texture bound to
+// the pixmap itself would show what the client is drawing right now.
+void MTexturePixmapPrivate::freezeContents()
+{
+    if (frozen_pixmap || !TFP.drawable || direct_fb_render
+        || item->propertyCache()->isVirtual()
+        || MTextureFromPixmap::copiesContents())
+        // the texture only changes when we update() it
+        return;
+
+    Display *dpy = QX11Info::display();
+    Window root;
+    int x, y;
+    unsigned w, h, border, depth;
+    if (!XGetGeometry(dpy, TFP.drawable, &root, &x, &y, &w, &h,
+                      &border, &depth))
+        return;
+    frozen_pixmap = XCreatePixmap(dpy, root, w, h, depth);
+    GC gc = XCreateGC(dpy, frozen_pixmap, 0, 0);
+    XCopyArea(dpy, TFP.drawable, frozen_pixmap, gc, 0, 0, w, h, 0, 0);
+    XFreeGC(dpy, gc);
+
+    const Drawable live = TFP.drawable;
+    TFP.bind(frozen_pixmap);
+    TFP.drawable = live;
+}
+
+// Bind the window pixmap again, or the one it's been renamed to meanwhile.
+void MTexturePixmapPrivate::thawContents()
+{
+    if (!frozen_pixmap || item->isClosing())
+        // keep the last contents for the animation
+        return;
+    TFP.bind(TFP.drawable);
+    XFreePixmap(QX11Info::display(), frozen_pixmap);
+    frozen_pixmap = None;
 }
 
 void MTexturePixmapPrivate::resize(int w, int h)
@@ -585,12 +995,36 @@ void MTexturePixmapPrivate::resize(int w, int h)
     if (!window)
         return;
     
-    if (!brect.isEmpty() && !item->isDirectRendered() && (brect.width() != w || brect.height() != h)) {
-        item->saveBackingStore();
-        item->updateWindowPixmap();
-    }
+    bool resized = !brect.isEmpty() && !item->isDirectRendered() && (brect.width() != w || brect.height() != h);
     brect.setWidth(w);
     brect.setHeight(h);
+    if (resized) {
+        pixmap_stale = true;
+        damageRegion = brect;
+#ifdef GLES2_VERSION
+        if (current_window_group)
+            current_window_group->memberDamaged(item, damageRegion);
+        else
+#endif
+            glwidget->update();
+    }
+}
+
+// Name and bind the pixmap of the window's current size if it's been
+// resized, once for any number of configures in between.
+void MTexturePixmapPrivate::renamePixmap()
+{
+    if (!pixmap_stale)
+        return;
+    if (direct_fb_render || item->isClosing()) {
+        // nothing to show or keep the last one for the animation
+        pixmap_stale = false;
+        return;
+    }
+    saveBackingStore();
+    TFP.update();
+    invalidateBlurCache();
+    item->propertyCache()->damageSubtract();
 }
 
 void MTexturePixmapItem::updateWindowPixmapProxy()
@@ -627,6 +1061,16 @@ void MTexturePixmapItem::saveBackingStore()
     d->saveBackingStore();
 }
 
+void MTexturePixmapItem::freezeContents()
+{
+    d->freezeContents();
+}
+
+void MTexturePixmapItem::thawContents()
+{
+    d->thawContents();
+}
+
 void MTexturePixmapItem::resize(int w, int h)
 {
     d->resize(w, h);
@@ -48,6 +48,7 @@ class QTransform;
 class MGLResourceManager;
 class MCompositeWindowShaderEffect;
 class MCompositeWindowGroup;
+class MBlurCache;
 
 /*! Internal private implementation of MTexturePixmapItem
   Warning! Interface here may change at any time!
@@ -61,6 +62,9 @@ public:
     void init();
     void updateWindowPixmap(XRectangle *rects = 0, int num = 0);
     void saveBackingStore();
+    void renamePixmap();
+    void freezeContents();
+    void thawContents();
     void clearTexture();
     bool isDirectRendered() const;
     void resize(int w, int h);
@@ -71,10 +75,16 @@ public:
                        qreal opacity, bool texcoords_from_rect = false);
     void q_drawTexture(const QTransform& transform, const QRectF& drawRect,
                        qreal opacity, const GLvoid* texCoords);
+    void drawBlurredTexture(const QTransform& transform, const QRectF& drawRect,
+                            qreal opacity, qreal radius, int passes);
+    void invalidateBlurCache();
     void installEffect(MCompositeWindowShaderEffect* effect);
     void paint(QPainter *painter);
     void renderTexture(const QTransform& transform);
+    bool scissor(const QRect &r) const;
+    GLuint shaderProgramId() const;
     static GLuint installPixelShader(const QByteArray& code);
+    static void precompilePixelShader(const QByteArray& code);
                 
     static QGLContext *ctx;
     static QGLWidget *glwidget;
@@ -85,6 +95,9 @@ public:
 
     QRect brect;
     QRegion damageRegion;
+    // If set, renderTexture() only touches this area of the render
+    // target (in GL coordinates).  Used by window groups.
+    QRect clip_rect;
     QTimer damageRetryTimer;
     qreal angle;
 
@@ -99,6 +112,13 @@ public:
     // notifications for this window.  Only used by the EGL variant
     // to throttle repairs if the window is transitioning.
     QList<Time> *pastDamages;
+    MBlurCache *blur_cache;
+    // The window has been resized since its pixmap was named.  Configures
+    // come in bursts when rotating or resizing, so the new pixmap is only
+    // named by renamePixmap() when the window is painted.
+    bool pixmap_stale;
+    // Copy of the window pixmap bound to the texture by freezeContents().
+    Pixmap frozen_pixmap;
 #ifdef WINDOW_DEBUG
     unsigned item_painted; // for unit testing
 #endif
@@ -0,0 +1,274 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mtimerwheel.h"
+
+MTimerWheel *MTimerWheel::wheel = 0;
+
+static inline bool isEmpty(const MWheelNode *slot)
+{
+    return slot->next == slot;
+}
+
+static inline void unlink(MWheelNode *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = node;
+}
+
+static inline void append(MWheelNode *slot, MWheelNode *node)
+{
+    node->prev = slot->prev;
+    node->next = slot;
+    slot->prev->next = node;
+    slot->prev = node;
+}
+
+MWheelTimer::MWheelTimer(QObject *parent)
+    : QObject(parent), expires(0), interval_ms(0), single_shot(false)
+{
+    node.timer = this;
+}
+
+MWheelTimer::~MWheelTimer()
+{
+    stop();
+}
+
+void MWheelTimer::start()
+{
+    MTimerWheel::instance()->add(this);
+}
+
+void MWheelTimer::stop()
+{
+    if (isActive())
+        MTimerWheel::wheel->remove(this);
+}
+
+MTimerWheel *MTimerWheel::instance()
+{
+    if (!wheel)
+        wheel = new MTimerWheel();
+    return wheel;
+}
+
+MTimerWheel::MTimerWheel()
+    : current(0), scheduled(0), ntimers(0), dispatching(false)
+{
+    clock.start();
+    dispatch_timer.setSingleShot(true);
+    connect(&dispatch_timer, SIGNAL(timeout()), SLOT(dispatch()));
+}
+
+MTimerWheel::~MTimerWheel()
+{
+    // Leave the timers inactive.
+    for (int i = 0; i < Level0Size; ++i)
+        while (!isEmpty(&level0[i]))
+            unlink(level0[i].next);
+    for (int i = 0; i < LevelNSize; ++i) {
+        while (!isEmpty(&level1[i]))
+            unlink(level1[i].next);
+        while (!isEmpty(&level2[i]))
+            unlink(level2[i].next);
+    }
+    wheel = 0;
+}
+
+// (Re)start @timer.
+void MTimerWheel::add(MWheelTimer *timer)
+{
+    if (timer->isActive())
+        remove(timer);
+    else if (!ntimers)
+        // Nothing to process until now.
+        current = qMax(current, now());
+
+    // Round up so it doesn't fire early.
+    timer->expires = (clock.elapsed() + qMax(timer->interval_ms, 0)
+                      + TickMs - 1) / TickMs;
+    insert(timer);
+    ntimers++;
+
+    // dispatch() reschedules when it's finished.
+    if (!dispatching && (!dispatch_timer.isActive()
+                         || timer->expires < scheduled)) {
+        scheduled = qMax(timer->expires, current);
+        dispatch_timer.start(qMax(int(scheduled * TickMs - clock.elapsed()),
+                                  0));
+    }
+}
+
+// Put @timer in the slot of its level.  It's not counted.
+void MTimerWheel::insert(MWheelTimer *timer)
+{
+    qint64 expires = qMax(timer->expires, current);
+    qint64 delta = expires - current;
+    MWheelNode *slot;
+
+    if (delta < Level0Size) {
+        slot = &level0[expires & (Level0Size-1)];
+    } else if (delta < Level1Span) {
+        slot = &level1[(expires >> Level0Bits) & (LevelNSize-1)];
+    } else {
+        // If it's even farther it's moved down at the end of the wheel
+        // and put back here.
+        if (delta >= Level2Span)
+            expires = current + Level2Span - 1;
+        slot = &level2[(expires >> (Level0Bits+LevelNBits)) & (LevelNSize-1)];
+    }
+    append(slot, &timer->node);
+}
+
+void MTimerWheel::remove(MWheelTimer *timer)
+{
+    unlink(&timer->node);
+    if (!--ntimers)
+        dispatch_timer.stop();
+}
+
+// Redistribute the timers of a higher level @slot whose time has come.
+void MTimerWheel::cascade(MWheelNode *slot)
+{
+    MWheelNode list;
+    if (isEmpty(slot))
+        return;
+
+    // Move them to @list first because insert() may put some of them
+    // back to @slot.
+    list.next = slot->next;
+    list.prev = slot->prev;
+    list.next->prev = list.prev->next = &list;
+    slot->next = slot->prev = slot;
+
+    while (!isEmpty(&list)) {
+        MWheelNode *node = list.next;
+        unlink(node);
+        insert(node->timer);
+    }
+}
+
+// Fire the timers which have expired until the tick @to.
+void MTimerWheel::advance(qint64 to)
+{
+    while (current <= to) {
+        if (!ntimers) {
+            current = to + 1;
+            break;
+        }
+
+        const qint64 tick = current;
+        const int index = tick & (Level0Size-1);
+        if (!index) {
+            // New round of the first level, take the timers of this round
+            // from the second one, and likewise from the third one.
+            const int index1 = (tick >> Level0Bits) & (LevelNSize-1);
+            if (!index1)
+                cascade(&level2[(tick >> (Level0Bits+LevelNBits))
+                                & (LevelNSize-1)]);
+            cascade(&level1[index1]);
+        }
+
+        // Timers started by the ones we fire go to the next ticks.
+        MWheelNode expired;
+        MWheelNode *slot = &level0[index];
+        current = tick + 1;
+        if (isEmpty(slot))
+            continue;
+        expired.next = slot->next;
+        expired.prev = slot->prev;
+        expired.next->prev = expired.prev->next = &expired;
+        slot->next = slot->prev = slot;
+
+        // @expired is always consistent, the timers we fire can stop
+        // or delete any of the rest.
+        while (!isEmpty(&expired)) {
+            MWheelTimer *timer = expired.next->timer;
+            unlink(&timer->node);
+            ntimers--;
+            if (!timer->single_shot)
+                add(timer);
+            emit timer->timeout();
+        }
+    }
+}
+
+// Returns the tick to wake up at, or -1 if there's nothing to do.
+qint64 MTimerWheel::nextDeadline() const
+{
+    qint64 deadline = -1;
+
+    // The slots of the first level are in the order of expiry from
+    // @current, so the first non-empty one is the earliest.
+    for (int i = 0; i < Level0Size; ++i)
+        if (!isEmpty(&level0[(current + i) & (Level0Size-1)])) {
+            deadline = current + i;
+            break;
+        }
+
+    // The second level can have earlier timers if they were added
+    // before @current.
+    const qint64 base1 = current >> Level0Bits;
+    for (int i = 1; i <= LevelNSize; ++i) {
+        const MWheelNode *slot = &level1[(base1 + i) & (LevelNSize-1)];
+        if (isEmpty(slot))
+            continue;
+        for (const MWheelNode *node = slot->next; node != slot;
+             node = node->next)
+            if (deadline < 0 || node->timer->expires < deadline)
+                deadline = node->timer->expires;
+        break;
+    }
+
+    // Wake up to cascade the third level, the timers may not be sorted
+    // there.
+    const qint64 base2 = current >> (Level0Bits+LevelNBits);
+    for (int i = 1; i <= LevelNSize; ++i) {
+        if (isEmpty(&level2[(base2 + i) & (LevelNSize-1)]))
+            continue;
+        const qint64 start = (base2 + i) << (Level0Bits+LevelNBits);
+        if (deadline < 0 || start < deadline)
+            deadline = start;
+        break;
+    }
+
+    return deadline;
+}
+
+void MTimerWheel::schedule()
+{
+    const qint64 deadline = ntimers ? nextDeadline() : -1;
+    if (deadline < 0) {
+        dispatch_timer.stop();
+        return;
+    }
+
+    scheduled = qMax(deadline, current);
+    dispatch_timer.start(qMax(int(scheduled * TickMs - clock.elapsed()), 0));
+}
+
+void MTimerWheel::dispatch()
+{
+    dispatching = true;
+    advance(now());
+    dispatching = false;
+    schedule();
+}
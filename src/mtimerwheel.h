@@ -0,0 +1,132 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MTIMERWHEEL_H
+#define MTIMERWHEEL_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+class MWheelTimer;
+
+// Link of a timer in a slot of the wheel.  The slots are circular lists
+// with a dummy head, so a timer can unlink itself without knowing where
+// it is.
+struct MWheelNode
+{
+    MWheelNode() : prev(this), next(this), timer(0) { }
+    MWheelNode *prev, *next;
+    MWheelTimer *timer;
+};
+
+/*!
+ * Drop-in replacement of QTimer for the many per-window timers which
+ * are mostly idle and restarted often.  Instead of registering with the
+ * event dispatcher each of them is kept in a slot of the compositor-wide
+ * MTimerWheel, so starting and stopping them are a few pointer operations,
+ * and all of them are fired from a single QTimer.  The resolution is
+ * MTimerWheel::TickMs, and they never fire earlier than asked.
+ */
+class MWheelTimer: public QObject
+{
+    Q_OBJECT
+public:
+    MWheelTimer(QObject *parent = 0);
+    ~MWheelTimer();
+
+    void setInterval(int msec)          { interval_ms = msec; }
+    int interval() const                { return interval_ms; }
+    void setSingleShot(bool singleShot) { single_shot = singleShot; }
+    bool isSingleShot() const           { return single_shot; }
+    bool isActive() const               { return node.next != &node; }
+
+public slots:
+    void start();
+    void start(int msec)                { interval_ms = msec; start(); }
+    void stop();
+
+signals:
+    void timeout();
+
+private:
+    friend class MTimerWheel;
+    MWheelNode node;
+    qint64 expires;
+    int interval_ms;
+    bool single_shot;
+};
+
+/*!
+ * Hierarchical timer wheel keeping the deadlines of the MWheelTimers.
+ * The first level has a slot for each tick of the next TickMs * 256 ms,
+ * the second and the third levels have 64 slots of 256 and 256 * 64
+ * ticks, which are redistributed to the lower level when it gets there.
+ * The dispatcher timer is only started for the earliest deadline.
+ */
+class MTimerWheel: public QObject
+{
+    Q_OBJECT
+public:
+    enum { TickMs = 8 };
+
+    static MTimerWheel *instance();
+    ~MTimerWheel();
+
+    // Number of active timers.
+    int count() const { return ntimers; }
+
+private slots:
+    void dispatch();
+
+private:
+    friend class MWheelTimer;
+    enum {
+        Level0Bits = 8, Level0Size = 1 << Level0Bits,
+        LevelNBits = 6, LevelNSize = 1 << LevelNBits,
+        Level1Span = 1 << (Level0Bits + LevelNBits),
+        Level2Span = 1 << (Level0Bits + 2*LevelNBits)
+    };
+
+    MTimerWheel();
+    qint64 now() const { return clock.elapsed() / TickMs; }
+    void add(MWheelTimer *timer);
+    void insert(MWheelTimer *timer);
+    void remove(MWheelTimer *timer);
+    void cascade(MWheelNode *slot);
+    void advance(qint64 to);
+    qint64 nextDeadline() const;
+    void schedule();
+
+    static MTimerWheel *wheel;
+    QElapsedTimer clock;
+    // The next tick to process.
+    qint64 current;
+    // When @dispatch_timer will fire, in ticks.
+    qint64 scheduled;
+    int ntimers;
+    bool dispatching;
+    QTimer dispatch_timer;
+
+    MWheelNode level0[Level0Size];
+    MWheelNode level1[LevelNSize];
+    MWheelNode level2[LevelNSize];
+};
+
+#endif
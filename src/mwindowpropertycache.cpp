@@ -28,17 +28,18 @@
 #include <X11/Xmd.h>
 #include "mcompositemanager.h"
 #include "mwindowpropertycache.h"
+#include "mtimerwheel.h"
 #include "mcompositemanager_p.h"
 
 #define MAX_TYPES 10
 
-// Simple derivate of QTimer to stop itself when nobody is connected to
-// timeout().  Used for MWindowPropertyCache::collect_timer to avoid
+// Simple derivate of MWheelTimer to stop itself when nobody is connected
+// to timeout().  Used for MWindowPropertyCache::collect_timer to avoid
 // unnecessary wakeups.
-class MCSmartTimer: public QTimer
+class MCSmartTimer: public MWheelTimer
 {
 public:
-    MCSmartTimer(QObject *parent): QTimer(parent) { }
+    MCSmartTimer(QObject *parent): MWheelTimer(parent) { }
     void disconnect(const char *slot)
     {
       QObject::disconnect(this, SIGNAL(timeout()), parent(), slot);
@@ -49,6 +50,7 @@ public:
 
 xcb_render_query_pict_formats_reply_t *MWindowPropertyCache::pict_formats_reply = 0;
 xcb_render_query_pict_formats_cookie_t MWindowPropertyCache::pict_formats_cookie = {0};
+QSet<Window> MWindowPropertyCache::being_mapped_windows;
 
 // Returns whether the property of @collector does not need to be refreshed:
 // if it has been requested and it has been replied.
@@ -124,6 +126,7 @@ xcb_connection_t *MWindowPropertyCache::xcb_conn;
 void MWindowPropertyCache::init()
 {
     wm_pid = 0;
+    sync_counter = frame_counter = None;
     transient_for = None,
     invoked_by = None,
     has_alpha = -1;
@@ -276,6 +279,9 @@ MWindowPropertyCache::MWindowPropertyCache(Window w,
                requestProperty(MCompAtoms::WM_NAME, XCB_ATOM_STRING, 100));
     addRequest(pidKey, SLOT(pid()), requestProperty(MCompAtoms::_NET_WM_PID,
                                                     XCB_ATOM_CARDINAL));
+    addRequest(syncCounterKey, SLOT(syncCounter()),
+               requestProperty(MCompAtoms::_NET_WM_SYNC_REQUEST_COUNTER,
+                               XCB_ATOM_CARDINAL, 2));
     addRequest(noAnimationsKey, SLOT(noAnimations()),
                requestProperty(MCompAtoms::_MEEGOTOUCH_NO_ANIMATIONS,
                                XCB_ATOM_CARDINAL));
@@ -305,6 +311,8 @@ MWindowPropertyCache::MWindowPropertyCache()
 
 MWindowPropertyCache::~MWindowPropertyCache()
 {
+    if (being_mapped)
+        being_mapped_windows.remove(window);
     if (!is_valid || is_virtual) {
         // no pending XCB requests
         XFree(wmhints);
@@ -328,6 +336,15 @@ MWindowPropertyCache::~MWindowPropertyCache()
     damageTracking(false);
 }
 
+void MWindowPropertyCache::setBeingMapped(bool s)
+{
+    being_mapped = s;
+    if (s)
+        being_mapped_windows.insert(window);
+    else
+        being_mapped_windows.remove(window);
+}
+
 bool MWindowPropertyCache::hasAlpha()
 {
     if (!is_valid || has_alpha != -1)
@@ -847,6 +864,11 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
             addRequest(pidKey, SLOT(pid()),
                        requestProperty(MCompAtoms::_NET_WM_PID,
                                        XCB_ATOM_CARDINAL));
+    } else if (e->atom == ATOM(_NET_WM_SYNC_REQUEST_COUNTER)) {
+        sync_counter = frame_counter = None;
+        if (e->state == PropertyNewValue)
+            addRequest(syncCounterKey, SLOT(syncCounter()),
+                       requestProperty(e->atom, XCB_ATOM_CARDINAL, 2));
     } else if (e->state == PropertyNewValue
                && e->atom == ATOM(_MEEGOTOUCH_PRESTARTED)) {
         prestarted = true;
@@ -863,6 +885,34 @@ unsigned MWindowPropertyCache::pid()
     return wm_pid;
 }
 
+XID MWindowPropertyCache::syncCounter()
+{
+    const CollectorKey me = syncCounterKey;
+    if (is_valid && requests[me].requested && requests[me].cookie) {
+        xcb_get_property_reply_t *r;
+        xcb_get_property_cookie_t c = { requests[me].cookie };
+        r = xcb_get_property_reply(xcb_conn, c, 0);
+        replyCollected(me);
+        sync_counter = frame_counter = None;
+        if (r) {
+            int n = xcb_get_property_value_length(r) / sizeof(CARD32);
+            const CARD32 *counters = (CARD32 *)xcb_get_property_value(r);
+            if (n >= 1)
+                sync_counter = counters[0];
+            if (n >= 2)
+                frame_counter = counters[1];
+            free(r);
+        }
+    }
+    return sync_counter;
+}
+
+XID MWindowPropertyCache::frameCounter()
+{
+    syncCounter();
+    return frame_counter;
+}
+
 int MWindowPropertyCache::windowState()
 {
     const CollectorKey me = windowStateKey;
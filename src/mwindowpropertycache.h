@@ -23,6 +23,7 @@
 #include <QRegion>
 #include <QX11Info>
 #include <QVector>
+#include <QSet>
 #include <X11/Xutil.h>
 #include <X11/Xlib-xcb.h>
 #include <X11/Xmd.h>
@@ -86,6 +87,7 @@ public:
         windowTypeAtomKey,
         realGeometryKey,
         wmNameKey,
+        syncCounterKey,
         lastCollectorKey
     };
 
@@ -150,7 +152,12 @@ public:
      * the MapNotify yet.
      */
     bool beingMapped() const { return being_mapped; }
-    void setBeingMapped(bool s) { being_mapped = s; }
+    void setBeingMapped(bool s);
+    /*!
+     * The windows whose beingMapped() is true.
+     */
+    static const QSet<Window> &beingMappedWindows()
+        { return being_mapped_windows; }
     void setDontIconify(bool s) { dont_iconify = s; }
     bool dontIconify();
     bool isLockScreen();
@@ -201,6 +208,12 @@ public slots:
     Atom windowTypeAtom();
     unsigned pid();
 
+    //! Returns the XSync counter of _NET_WM_SYNC_REQUEST_COUNTER or None.
+    XID syncCounter();
+    //! Returns the second (extended) counter of it, which the client
+    //! makes odd while it's drawing a frame, or None.
+    XID frameCounter();
+
     const XWMHints &getWMHints();
     const QRect realGeometry();
     const QRectF &iconGeometry();
@@ -412,11 +425,13 @@ protected:
     static xcb_connection_t *xcb_conn;
     static xcb_render_query_pict_formats_reply_t *pict_formats_reply;
     static xcb_render_query_pict_formats_cookie_t pict_formats_cookie;
+    static QSet<Window> being_mapped_windows;
     Damage damage_object;
     int damage_report_level;
     int waiting_for_damage;
     QString wm_name;
     unsigned wm_pid, no_animations;
+    XID sync_counter, frame_counter;
     int video_overlay;
     bool pending_damage;
     bool skipping_taskbar_marker;
@@ -0,0 +1,174 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mxserverlatency.h"
+
+#include <QByteArray>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+// Lower bound of @bucket in microseconds.
+static quint32 bucketStart(int bucket)
+{
+    const int octave = bucket / MXServerLatency::SubBuckets;
+    const int sub = bucket % MXServerLatency::SubBuckets;
+    return (1u << octave) + (sub << octave) / MXServerLatency::SubBuckets;
+}
+
+static int bucketOf(quint32 us)
+{
+    int octave = 0;
+    if (!us)
+        return 0;
+    while (octave < 31 && (us >> (octave + 1)))
+        octave++;
+    int bucket = octave * MXServerLatency::SubBuckets
+        + ((us - (1u << octave)) * MXServerLatency::SubBuckets >> octave);
+    return qMin(bucket, int(MXServerLatency::NBuckets) - 1);
+}
+
+MXServerLatency *MXServerLatency::instance()
+{
+    static MXServerLatency *page;
+    static bool tried;
+    if (page || tried)
+        return page;
+    tried = true;
+
+    QByteArray name = "/mcompositor-xlatency-" + QByteArray::number(getuid());
+    int fd = shm_open(name.constData(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (st.st_size >= (off_t)sizeof(*page)
+                     || ftruncate(fd, sizeof(*page)) == 0))
+        p = mmap(0, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p != MAP_FAILED)
+        page = static_cast<MXServerLatency*>(p);
+    return page;
+}
+
+qint64 MXServerLatency::now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void MXServerLatency::reset()
+{
+    // Make it odd even if the previous pinger died in the middle of an
+    // update and left it so.
+    seq |= 1;
+    __sync_synchronize();
+    samples = stalls = p50 = p90 = p99 = max = 0;
+    memset(histogram, 0, sizeof(histogram));
+    __sync_synchronize();
+    seq++;
+}
+
+void MXServerLatency::record(quint32 us)
+{
+    seq++;
+    __sync_synchronize();
+
+    histogram[bucketOf(us)]++;
+    samples++;
+    if (us > max)
+        max = us;
+
+    // Update the percentiles.
+    const quint32 n50 = (samples * 50 + 99) / 100;
+    const quint32 n90 = (samples * 90 + 99) / 100;
+    const quint32 n99 = (samples * 99 + 99) / 100;
+    quint32 n = 0;
+    for (int i = 0; i < NBuckets; ++i) {
+        const quint32 prev = n;
+        n += histogram[i];
+        if (prev < n50 && n >= n50)
+            p50 = bucketStart(i);
+        if (prev < n90 && n >= n90)
+            p90 = bucketStart(i);
+        if (prev < n99 && n >= n99) {
+            p99 = bucketStart(i);
+            break;
+        }
+    }
+
+    __sync_synchronize();
+    seq++;
+}
+
+void MXServerLatency::stalled()
+{
+    seq++;
+    __sync_synchronize();
+    stalls++;
+    __sync_synchronize();
+    seq++;
+}
+
+bool MXServerLatency::drawnWithin(int ms) const
+{
+    return quint32(now_us() / 1000) - last_frame_ms < quint32(ms);
+}
+
+bool MXServerLatency::stats(Stats &st) const
+{
+    quint32 s;
+    int tries = 0;
+
+    // Retry if the pinger was writing, but not forever in case it died
+    // while doing so.
+    do {
+        if (++tries > MaxTries)
+            return false;
+        s = seq;
+        __sync_synchronize();
+        st.samples = samples;
+        st.stalls = stalls;
+        st.p50 = p50;
+        st.p90 = p90;
+        st.p99 = p99;
+        st.max = max;
+        __sync_synchronize();
+    } while ((s & 1) || s != seq);
+    return true;
+}
+
+QString MXServerLatency::toString() const
+{
+    Stats st;
+    if (!stats(st))
+        return "unavailable";
+    if (!st.samples)
+        return "no samples";
+    return QString().sprintf("%u samples, 50%%: %u us, 90%%: %u us, "
+                             "99%%: %u us, max: %u us, stalls: %u",
+                             st.samples, st.p50, st.p90, st.p99, st.max,
+                             st.stalls);
+}
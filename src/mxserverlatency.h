@@ -0,0 +1,76 @@
+/***************************************************************************
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MXSERVERLATENCY_H
+#define MXSERVERLATENCY_H
+
+#include <QString>
+
+/*!
+ * Histogram of the X server round-trip times measured by the xserverping
+ * process, shared with the compositor through a shared memory page.
+ * The compositor tells the pinger when it's drawing with frameDrawn(),
+ * so it can ping more often then, and shows the statistics in dumpState().
+ *
+ * The buckets are a quarter octave wide, from 1 us to ~16 s.
+ * Percentiles are the lower bound of the bucket they fall into.
+ */
+struct MXServerLatency
+{
+    enum { SubBuckets = 4, NBuckets = 24 * SubBuckets, MaxTries = 1000 };
+
+    // Returns the page, creating it if it doesn't exist, or 0.
+    static MXServerLatency *instance();
+
+    // Monotonic time, comparable between the processes.
+    static qint64 now_us();
+
+    // Called by the pinger.
+    void reset();
+    void record(quint32 us);
+    void stalled();
+    // The compositor has drawn something in the last @ms.
+    bool drawnWithin(int ms) const;
+
+    // Called by the compositor.
+    struct Stats {
+        quint32 samples, stalls, p50, p90, p99, max;
+    };
+    void frameDrawn() { last_frame_ms = quint32(now_us() / 1000); }
+    // The display is off, the pinger should let the device sleep.
+    void setSleeping(bool s) { sleeping = s; }
+    // Returns false if the page has been inconsistent for too long.
+    bool stats(Stats &st) const;
+    QString toString() const;
+
+    // Odd while the pinger is updating the page.
+    volatile quint32 seq;
+    // 32 bits so that the pinger can't read it half-written on 32-bit
+    // CPUs.  It wraps around every 49 days, which drawnWithin() handles.
+    volatile quint32 last_frame_ms;
+
+    quint32 samples;
+    // Pings unanswered for a whole interval.
+    quint32 stalls;
+    quint32 p50, p90, p99, max;
+    quint32 histogram[NBuckets];
+    volatile quint32 sleeping;
+};
+
+#endif
@@ -52,7 +52,11 @@ HEADERS += \
     mcompositewindowanimation.h \
     mdynamicanimation.h \
     mrestacker.h \
-    mstatusbartexture.h
+    mstatusbartexture.h \
+    mtimerwheel.h \
+    mxserverlatency.h \
+    mjsonwriter.h \
+    meventrecorder.h
 
 SOURCES += \
     mtexturepixmapitem_p.cpp \
@@ -69,7 +73,11 @@ SOURCES += \
     mcompositewindowanimation.cpp \
     mdynamicanimation.cpp \
     mrestacker.cpp \
-    mstatusbartexture.cpp
+    mstatusbartexture.cpp \
+    mtimerwheel.cpp \
+    mxserverlatency.cpp \
+    mjsonwriter.cpp \
+    meventrecorder.cpp
 
 CONFIG += release link_pkgconfig
 PKGCONFIG += contextsubscriber-1.0 contextprovider-1.0
@@ -98,7 +106,7 @@ contextkitXml.path = /usr/share/contextkit/providers
 INSTALLS += contextkitXml
 
 LIBS += -lXdamage -lXcomposite -lXfixes -lX11-xcb -lxcb-render -lxcb-shape \
-        -lXrandr ../decorators/libdecorator/libdecorator.so
+        -lXrandr -lXext -lrt ../decorators/libdecorator/libdecorator.so
 
 QMAKE_EXTRA_TARGETS += check
 check.depends = $$TARGET
@@ -40,6 +40,15 @@ static const char* TexpFragShaderSource = "\
             gl_FragColor = texture2D(texture, fragTexCoord) * opacity; \
     }";
 
+// variant of TexpFragShaderSource for fully opaque draws
+static const char* TexpOpaqueFragShaderSource = "\
+    varying mediump vec2 fragTexCoord;\
+    uniform sampler2D texture;\
+    void main(void) \
+    {\
+            gl_FragColor = texture2D(texture, fragTexCoord); \
+    }";
+
 static const char* TexpCustomShaderSource = "\
     varying mediump vec2 fragTexCoord;\n\
     uniform lowp sampler2D texture;\n\
@@ -65,26 +74,45 @@ static const char *AlphaTestFragShaderSource = "\
     }";
 #endif
 
-static const char *blurshader = "\
-varying lowp vec2 fragTexCoord;\
-uniform sampler2D texture0;\
+/*
+ * Dual-filter ("Kawase") blur.  The source is downsampled with
+ * blurdownshader to half size a number of times and scaled back up with
+ * blurupshader, each pass sampling around the pixel at @blurstep distance.
+ * @halfpixel is half a texel of the render target.
+ */
+static const char *blurdownshader = "\
+varying mediump vec2 fragTexCoord;\
+uniform sampler2D texture;\
+uniform mediump vec2 halfpixel;\
+uniform mediump float blurstep;\
+void main(void)\
+{\
+mediump vec2 d = halfpixel * blurstep;\
+mediump vec4 sum = texture2D(texture, fragTexCoord) * 4.0;\
+sum += texture2D(texture, fragTexCoord - d);\
+sum += texture2D(texture, fragTexCoord + d);\
+sum += texture2D(texture, fragTexCoord + vec2(d.x, -d.y));\
+sum += texture2D(texture, fragTexCoord - vec2(d.x, -d.y));\
+gl_FragColor = sum / 8.0;\
+}";
+
+static const char *blurupshader = "\
+varying mediump vec2 fragTexCoord;\
+uniform sampler2D texture;\
+uniform mediump vec2 halfpixel;\
 uniform mediump float blurstep;\
 void main(void)\
 {\
-mediump vec4 sample0,\
-sample1,\
-sample2,\
-sample3;\
-mediump float step = blurstep / 100.0;\
-mediump vec2 upperleft = fragTexCoord.xy - vec2(step);\
-mediump vec2 lowerright = fragTexCoord.xy + vec2(step);\
-mediump vec2 upperright = fragTexCoord.xy + vec2(step, -step);\
-mediump vec2 lowerleft = fragTexCoord.xy + vec2(-step, step);\
-sample0 = texture2D(texture0, upperleft); \
-sample1 = texture2D(texture0, lowerright); \
-sample2 = texture2D(texture0, upperright); \
-sample3 = texture2D(texture0, lowerleft); \
-gl_FragColor = ((sample0 + sample1 + sample2 + sample3) / 4.0) * 0.5;\
+mediump vec2 d = halfpixel * blurstep;\
+mediump vec4 sum = texture2D(texture, fragTexCoord + vec2(-d.x * 2.0, 0.0));\
+sum += texture2D(texture, fragTexCoord + vec2(-d.x, d.y)) * 2.0;\
+sum += texture2D(texture, fragTexCoord + vec2(0.0, d.y * 2.0));\
+sum += texture2D(texture, fragTexCoord + vec2(d.x, d.y)) * 2.0;\
+sum += texture2D(texture, fragTexCoord + vec2(d.x * 2.0, 0.0));\
+sum += texture2D(texture, fragTexCoord + vec2(d.x, -d.y)) * 2.0;\
+sum += texture2D(texture, fragTexCoord + vec2(0.0, -d.y * 2.0));\
+sum += texture2D(texture, fragTexCoord + vec2(-d.x, -d.y)) * 2.0;\
+gl_FragColor = sum / 12.0;\
 }";
 
 
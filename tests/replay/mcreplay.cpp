@@ -0,0 +1,360 @@
+/* Replays an X event trace recorded with mcompositor's "record" remote
+ * command against the compositor running on $DISPLAY (eg. Xvfb).
+ *
+ * The trace is what the compositor saw, so it's replayed from the client
+ * side: stand-in windows are created for the recorded ones and the
+ * requests of the original clients (map, configure, property changes,
+ * client messages, damage) are repeated on them.  The server-generated
+ * events follow from these.  The stand-ins answer _NET_WM_PING, so they
+ * don't get killed as hung.
+ *
+ * Usage: mcreplay [-s <speed>] <trace>
+ * <speed> 1 replays in the recorded timing, 2 twice as fast and so on.
+ * 0 (the default) replays back to back, for benchmarking.
+ *
+ * The timing is wall-clock: the compositor's timers aren't driven by the
+ * trace, so two replays of the same trace needn't end in the same state.
+ * */
+
+#include <QtCore>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/Xdamage.h>
+
+#include "meventrecorder.h"
+
+struct Property
+{
+    quint32 window, name, type;
+    quint8 format;
+    QVector<quint32> data;
+};
+
+static Display *dpy;
+static Window root;
+static GC gc;
+static Atom wm_protocols_atom, ping_atom, wm_state_atom;
+
+// Recorded => our atoms and windows.
+static QHash<quint32, Atom> atoms;
+static QHash<quint32, Window> windows;
+
+// Properties recorded before their window.
+static QHash<quint32, QList<Property> > pending;
+
+static int xerror_handler(Display *, XErrorEvent *)
+{
+    // The original client might have raced with the compositor.
+    return 0;
+}
+
+static Atom atom(quint32 a)
+{
+    // The predefined atoms are the same everywhere.
+    return atoms.value(a, a);
+}
+
+static Window window(quint32 w)
+{
+    return windows.value(w, None);
+}
+
+static void set_property(const Property &p)
+{
+    Window w = window(p.window);
+    if (w == None) {
+        pending[p.window].append(p);
+        return;
+    }
+
+    if (!p.format) {
+        XDeleteProperty(dpy, w, atom(p.name));
+        return;
+    }
+
+    Atom type = atom(p.type);
+    QVector<long> l(p.data.size());
+    QVector<short> s(p.data.size());
+    QVector<char> c(p.data.size());
+    unsigned char *data;
+    for (int i = 0; i < p.data.size(); ++i) {
+        quint32 v = p.data[i];
+        if (type == XA_ATOM)
+            v = atom(v);
+        else if (type == XA_WINDOW)
+            v = windows.value(v, v);
+        l[i] = v;
+        s[i] = v;
+        c[i] = v;
+    }
+    data = p.format == 32 ? (unsigned char *)l.data()
+         : p.format == 16 ? (unsigned char *)s.data()
+         : (unsigned char *)c.data();
+    XChangeProperty(dpy, w, atom(p.name), type, p.format, PropModeReplace,
+                    data, p.data.size());
+}
+
+static void create_window(QDataStream &in)
+{
+    quint32 w, parent;
+    qint16 x, y;
+    quint16 width, height, border;
+    quint8 override_redirect, input_only, viewable;
+    in >> w >> parent >> x >> y >> width >> height >> border
+       >> override_redirect >> input_only >> viewable;
+
+    XSetWindowAttributes attr;
+    attr.override_redirect = override_redirect;
+    attr.background_pixel = BlackPixel(dpy, DefaultScreen(dpy));
+    Window p = windows.value(parent, root);
+    Window ours = XCreateWindow(dpy, p, x, y, width, height, border,
+                                CopyFromParent,
+                                input_only ? InputOnly : InputOutput,
+                                CopyFromParent,
+                                input_only ? CWOverrideRedirect
+                                : CWOverrideRedirect | CWBackPixel, &attr);
+    windows[w] = ours;
+
+    foreach (const Property &prop, pending.take(w))
+        set_property(prop);
+    if (viewable)
+        XMapWindow(dpy, ours);
+}
+
+// Repeat what the client did to get @e.
+static bool replay_event(const XEvent &e, int damage_ev)
+{
+    Window w;
+
+    switch (e.type) {
+    case MapRequest:
+        if ((w = window(e.xmaprequest.window)) == None)
+            return false;
+        XMapWindow(dpy, w);
+        return true;
+    case UnmapNotify:
+        if ((w = window(e.xunmap.window)) == None)
+            return false;
+        if (e.xunmap.send_event) {
+            // ICCCM withdrawal
+            XEvent ev = e;
+            ev.xunmap.event = root;
+            ev.xunmap.window = w;
+            XSendEvent(dpy, root, False,
+                       SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+        } else
+            XUnmapWindow(dpy, w);
+        return true;
+    case DestroyNotify:
+        if ((w = window(e.xdestroywindow.window)) == None)
+            return false;
+        XDestroyWindow(dpy, w);
+        windows.remove(e.xdestroywindow.window);
+        return true;
+    case ConfigureRequest: {
+        const XConfigureRequestEvent &c = e.xconfigurerequest;
+        XWindowChanges wc;
+        if ((w = window(c.window)) == None)
+            return false;
+        wc.x = c.x;
+        wc.y = c.y;
+        wc.width = c.width;
+        wc.height = c.height;
+        wc.border_width = c.border_width;
+        wc.sibling = window(c.above);
+        wc.stack_mode = c.detail;
+        XConfigureWindow(dpy, w, wc.sibling != None ? c.value_mask
+                         : c.value_mask & ~CWSibling, &wc);
+        return true;
+    }
+    case ClientMessage: {
+        XEvent ev = e;
+        Atom type = atom(e.xclient.message_type);
+        if (type == wm_protocols_atom && atom(e.xclient.data.l[0]) == ping_atom)
+            // Ping replies are made up by us.
+            return false;
+        if ((ev.xclient.window = window(e.xclient.window)) == None)
+            ev.xclient.window = root;
+        ev.xclient.message_type = type;
+        if (e.xclient.format == 32) {
+            if (type == wm_state_atom) {
+                ev.xclient.data.l[1] = atom(e.xclient.data.l[1]);
+                ev.xclient.data.l[2] = atom(e.xclient.data.l[2]);
+            } else if (type == wm_protocols_atom)
+                ev.xclient.data.l[0] = atom(e.xclient.data.l[0]);
+        }
+        XSendEvent(dpy, root, False,
+                   SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+        return true;
+    }
+    default:
+        if (e.type == damage_ev) {
+            const XDamageNotifyEvent &d = (const XDamageNotifyEvent &)e;
+            static unsigned long color;
+            if ((w = window(d.drawable)) == None)
+                return false;
+            XSetForeground(dpy, gc, color ^= 0x808080);
+            XFillRectangle(dpy, w, gc, d.area.x, d.area.y,
+                           d.area.width, d.area.height);
+            return true;
+        }
+        // Generated by the server or the compositor.
+        return false;
+    }
+}
+
+// Answer pings and drop everything else.
+static void handle_events()
+{
+    while (XPending(dpy)) {
+        XEvent e;
+        XNextEvent(dpy, &e);
+        if (e.type == ClientMessage
+            && e.xclient.message_type == wm_protocols_atom
+            && (Atom)e.xclient.data.l[0] == ping_atom) {
+            e.xclient.window = root;
+            XSendEvent(dpy, root, False,
+                       SubstructureRedirectMask|SubstructureNotifyMask, &e);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    double speed = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        if (opt == 's')
+            speed = atof(optarg);
+        else {
+            fprintf(stderr, "usage: %s [-s <speed>] <trace>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-s <speed>] <trace>\n", argv[0]);
+        return 1;
+    }
+
+    QFile file(argv[optind]);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "couldn't open %s\n", argv[optind]);
+        return 1;
+    }
+    QDataStream in(&file);
+
+    char magic[7];
+    quint32 version;
+    quint16 damage_notify, shape_notify, event_size, width, height;
+    in.readRawData(magic, sizeof(magic));
+    in >> version >> damage_notify >> shape_notify >> event_size
+       >> width >> height;
+    if (memcmp(magic, "MCTRACE", sizeof(magic))
+        || version != MEventRecorder::Version) {
+        fprintf(stderr, "%s: not a trace or unknown version\n", argv[optind]);
+        return 1;
+    }
+    if (event_size != sizeof(XEvent)) {
+        fprintf(stderr, "%s: recorded on another architecture\n",
+                argv[optind]);
+        return 1;
+    }
+
+    if (!(dpy = XOpenDisplay(NULL))) {
+        fprintf(stderr, "couldn't open display\n");
+        return 1;
+    }
+    XSetErrorHandler(xerror_handler);
+    root = DefaultRootWindow(dpy);
+    gc = XCreateGC(dpy, root, 0, NULL);
+    wm_protocols_atom = XInternAtom(dpy, "WM_PROTOCOLS", False);
+    ping_atom = XInternAtom(dpy, "_NET_WM_PING", False);
+    wm_state_atom = XInternAtom(dpy, "_NET_WM_STATE", False);
+    if (width != DisplayWidth(dpy, DefaultScreen(dpy))
+        || height != DisplayHeight(dpy, DefaultScreen(dpy)))
+        fprintf(stderr, "warning: recorded on a %ux%u screen\n",
+                width, height);
+
+    // The server's DamageNotify number may differ from the recorded one.
+    int damage_event, damage_error;
+    if (!XDamageQueryExtension(dpy, &damage_event, &damage_error))
+        damage_event = -1;
+
+    unsigned nevents = 0, nreplayed = 0;
+    QElapsedTimer clock;
+    clock.start();
+    while (!in.atEnd()) {
+        quint32 ms;
+        quint8 type;
+        in >> ms >> type;
+
+        if (speed > 0) {
+            qint64 due = qint64(ms / speed);
+            XFlush(dpy);
+            while (clock.elapsed() < due) {
+                handle_events();
+                usleep(qMin(due - clock.elapsed(), qint64(10)) * 1000);
+            }
+        }
+
+        if (type == MEventRecorder::AtomRecord) {
+            quint32 a;
+            QByteArray name;
+            in >> a >> name;
+            atoms[a] = XInternAtom(dpy, name.constData(), False);
+        } else if (type == MEventRecorder::WindowRecord) {
+            create_window(in);
+        } else if (type == MEventRecorder::PropertyRecord) {
+            Property p;
+            quint32 nitems;
+            in >> p.window >> p.name >> p.type >> p.format >> nitems;
+            p.data.resize(nitems);
+            for (quint32 i = 0; p.format && i < nitems; ++i) {
+                quint8 c;
+                quint16 s;
+                switch (p.format) {
+                case 8:  in >> c; p.data[i] = c;  break;
+                case 16: in >> s; p.data[i] = s;  break;
+                case 32: in >> p.data[i];         break;
+                }
+            }
+            set_property(p);
+        } else if (type == MEventRecorder::EventRecord) {
+            XEvent e;
+            quint16 size;
+            in >> size;
+            memset(&e, 0, sizeof(e));
+            in.readRawData((char *)&e, qMin<int>(size, sizeof(e)));
+            if (size > sizeof(e))
+                in.skipRawData(size - sizeof(e));
+            if (e.type == damage_notify)
+                e.type = damage_event + XDamageNotify;
+            else if (e.type == shape_notify)
+                // Shapes aren't replayed.
+                continue;
+            nevents++;
+            if (replay_event(e, damage_event + XDamageNotify))
+                nreplayed++;
+        } else {
+            fprintf(stderr, "%s: corrupt trace\n", argv[optind]);
+            return 1;
+        }
+
+        if (in.status() != QDataStream::Ok) {
+            fprintf(stderr, "%s: truncated trace\n", argv[optind]);
+            break;
+        }
+        handle_events();
+    }
+
+    XSync(dpy, False);
+    printf("replayed %u of %u events in %lld ms\n", nreplayed, nevents,
+           (long long)clock.elapsed());
+
+    XCloseDisplay(dpy);
+    return 0;
+}
@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = mcreplay
+
+target.path=/usr/bin
+
+QT -= gui
+
+QMAKE_CXXFLAGS+= -Wall
+
+LIBS+=-lX11 -lXdamage
+
+DEPENDPATH += .
+INCLUDEPATH += . ../../src
+
+SOURCES += mcreplay.cpp
+
+INSTALLS += target
@@ -1,4 +1,4 @@
 TEMPLATE = subdirs
-SUBDIRS = windowctl windowstack focus-tracker functional manual-splash
+SUBDIRS = windowctl windowstack focus-tracker functional manual-splash replay
 # appinterface depends on libdecorator and is built by the toplevel Makefile
 # unit tests depend on libmcompositor and are built likewise
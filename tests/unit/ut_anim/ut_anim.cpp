@@ -150,6 +150,10 @@ void ut_Anim::initTestCase()
     // effectively disable ungrab-grab delay for testing the grab logic
     cmgr->config("ungrab-grab-delay", 0);
 
+    // switch to direct rendering as soon as possible
+    cmgr->config("unredirect-delay", 0);
+    cmgr->config("unredirect-max-delay", 0);
+
     // create a fake desktop window
     fake_desktop_window *pc = new fake_desktop_window(1000);
     addWindow(pc);
@@ -8,6 +8,7 @@
 #include <mtexturepixmapitem.h>
 #include <mcompositewindowanimation.h>
 #include <mdevicestate.h>
+#include <mcompositescene.h>
 #include "ut_compositing.h"
 
 #include <QtDebug>
@@ -68,6 +69,12 @@ public:
     void setTransientFor(Window w) { transient_for = w; }
     void addToTransients(Window w) { transients.append(w); }
     void setAlpha(bool b) { has_alpha = b; }
+    void setShape(const QRegion &r)
+    {
+        shape_region = r;
+        requests[shapeRegionKey].requested = true;
+        requests[shapeRegionKey].cookie = 0;
+    }
     Damage damageObject() const { return damage_object; }
     bool pendingDamage() { return pending_damage; }
 
@@ -119,6 +126,10 @@ void ut_Compositing::initTestCase()
     cmgr->d->prepare();
     cmgr->d->xserver_stacking.init();
 
+    // switch to direct rendering as soon as possible
+    cmgr->config("unredirect-delay", 0);
+    cmgr->config("unredirect-max-delay", 0);
+
     // create an altered MDeviceState
     device_state = new fake_device_state();
     delete cmgr->d->device_state;
@@ -698,6 +709,246 @@ void ut_Compositing::testDamageToObscuredSmallWindow()
     QCOMPARE(dlg->pendingDamage(), false);
 }
 
+void ut_Compositing::testUnredirectHold()
+{
+    cmgr->config("unredirect-delay", 100);
+    cmgr->config("unredirect-max-delay", 1000);
+
+    // hold as long as direct rendering has been lasting, within limits
+    cmgr->d->switches.direct_avg_ms = -1;
+    QCOMPARE(cmgr->d->holdTime(), 100);
+    cmgr->d->switches.direct_avg_ms = 400;
+    QCOMPARE(cmgr->d->holdTime(), 400);
+    cmgr->d->switches.direct_avg_ms = 5000;
+    QCOMPARE(cmgr->d->holdTime(), 100);
+
+    // holding is counted once
+    unsigned held = cmgr->d->switches.held;
+    QVERIFY(cmgr->d->holdCompositing());
+    QVERIFY(cmgr->d->unredirect_timer.isActive());
+    QVERIFY(cmgr->d->holdCompositing());
+    QCOMPARE(cmgr->d->switches.held, held + 1);
+    cmgr->d->unredirect_timer.stop();
+
+    // not while the display is off
+    device_state->fake_display_off = true;
+    QVERIFY(!cmgr->d->holdCompositing());
+    device_state->fake_display_off = false;
+
+    cmgr->config("unredirect-delay", 0);
+    cmgr->config("unredirect-max-delay", 0);
+    QVERIFY(!cmgr->d->holdCompositing());
+}
+
+void ut_Compositing::testNotificationBatching()
+{
+    const Window w = 100;
+    cmgr->d->flushNotifications();
+    quint64 sent = cmgr->d->counters.notifications;
+    quint64 deduped = cmgr->d->counters.notifications_deduped;
+
+    // only the last state of a batch is sent
+    cmgr->d->queueWindowState(w, NormalState);
+    cmgr->d->queueWindowState(w, IconicState);
+    cmgr->d->queueVisibility(w, VisibilityFullyObscured);
+    cmgr->d->queueVisibility(w, VisibilityUnobscured);
+    cmgr->d->flushNotifications();
+    QCOMPARE(cmgr->d->counters.notifications, sent + 2);
+    QCOMPARE(cmgr->d->sent_visibility.value(w), int(VisibilityUnobscured));
+
+    // nor is a VisibilityNotify that has been sent already, unless forced,
+    // but WM_STATE is, because the client may have changed it meanwhile
+    cmgr->d->queueWindowState(w, IconicState);
+    cmgr->d->queueVisibility(w, VisibilityUnobscured);
+    cmgr->d->flushNotifications();
+    QCOMPARE(cmgr->d->counters.notifications, sent + 3);
+    QCOMPARE(cmgr->d->counters.notifications_deduped, deduped + 1);
+    cmgr->d->queueVisibility(w, VisibilityUnobscured, true);
+    QVERIFY(cmgr->d->notify_timer.isActive());
+    cmgr->d->flushNotifications();
+    QCOMPARE(cmgr->d->counters.notifications, sent + 4);
+    QVERIFY(!cmgr->d->notify_timer.isActive());
+
+    cmgr->d->forgetNotifications(w);
+    QVERIFY(!cmgr->d->pending_wm_state.contains(w));
+    QVERIFY(!cmgr->d->sent_visibility.contains(w));
+}
+
+void ut_Compositing::testDeepSleep()
+{
+    cmgr->config("deep-sleep", 1);
+    device_state->fake_display_off = true;
+    cmgr->d->displayOff(true);
+    QVERIFY(cmgr->d->deep_sleep);
+
+    // no lockscreen, stacking waits for the display
+    quint64 checks = cmgr->d->counters.stacking_checks;
+    cmgr->d->dirtyStacking(true);
+    QVERIFY(!cmgr->d->stacking_timer.isActive());
+    cmgr->d->checkStacking(false);
+    QCOMPARE(cmgr->d->counters.stacking_checks, checks);
+    QVERIFY(cmgr->d->sleep_log.stacking);
+    QVERIFY(cmgr->d->sleep_log.visibility);
+
+    // and is caught up with when it's turned on
+    device_state->fake_display_off = false;
+    cmgr->d->displayOff(false);
+    QVERIFY(!cmgr->d->deep_sleep);
+    QVERIFY(!cmgr->d->sleep_log.stacking);
+    QVERIFY(cmgr->d->counters.stacking_checks > checks);
+}
+
+void ut_Compositing::testBatchDraws()
+{
+    // disjoint windows are grouped by program
+    QVector<int> order;
+    QVector<unsigned> programs;
+    QVector<QRegion> regions;
+    for (int i = 0; i < 4; ++i) {
+        order.append(i);
+        programs.append(i % 2 + 1);
+        regions.append(QRegion(i * 10, 0, 10, 10));
+    }
+    MCompositeScene::batchDraws(order, programs, regions);
+    QCOMPARE(order, QVector<int>() << 0 << 2 << 1 << 3);
+
+    // a draw is never moved over one it overlaps or an unknown one
+    qsrand(1);
+    for (int round = 0; round < 100; ++round) {
+        const int n = 3 + qrand() % 30;
+        order.resize(n);
+        programs.resize(n);
+        regions.resize(n);
+        for (int i = 0; i < n; ++i) {
+            order[i] = i;
+            programs[i] = qrand() % 4;
+            regions[i] = QRegion(qrand() % 100, qrand() % 100,
+                                 1 + qrand() % 30, 1 + qrand() % 30);
+        }
+        QVector<int> batched = order;
+        MCompositeScene::batchDraws(batched, programs, regions);
+        QCOMPARE(batched.size(), n);
+        QVector<int> pos(n, -1);
+        for (int i = 0; i < n; ++i) {
+            QCOMPARE(pos[batched[i]], -1);
+            pos[batched[i]] = i;
+        }
+        for (int i = 0; i < n; ++i)
+            for (int j = i + 1; j < n; ++j)
+                if (!programs[i] || !programs[j]
+                    || regions[i].intersects(regions[j]))
+                    QVERIFY(pos[i] < pos[j]);
+    }
+}
+
+// Put @w on the top of the stack for possiblyUnredirectTopmostWindow().
+static void raiseWindow(MCompositeManager *cmgr, Window w)
+{
+    cmgr->d->stacking_list.removeAll(w);
+    cmgr->d->stacking_list.append(w);
+}
+
+// fullscreen window with holes over an opaque app
+void ut_Compositing::testUnredirectShapedWindow()
+{
+    fake_LMT_window *app = new fake_LMT_window(13);
+    mapWindow(app);
+    MCompositeWindow *app_cw = cmgr->d->windows.value(13, 0);
+    fakeDamageEvent(app_cw);
+    fakeDamageEvent(app_cw);
+    while (app_cw->windowAnimator()->isActive())
+        QTest::qWait(500); // wait the animation to finish
+
+    fake_LMT_window *shaped = new fake_LMT_window(14);
+    mapWindow(shaped);
+    MCompositeWindow *shaped_cw = cmgr->d->windows.value(14, 0);
+    fakeDamageEvent(shaped_cw);
+    fakeDamageEvent(shaped_cw);
+    while (shaped_cw->windowAnimator()->isActive())
+        QTest::qWait(500); // wait the animation to finish
+    raiseWindow(cmgr, 13);
+    raiseWindow(cmgr, 14);
+
+    // the app shows through the hole, both are direct-rendered
+    shaped->setShape(QRegion(0, 0, dwidth, dheight)
+                     - QRegion(0, 0, dwidth / 2, dheight / 2));
+    QCOMPARE(cmgr->d->possiblyUnredirectTopmostWindow(), true);
+    QCOMPARE(cmgr->d->compositing, false);
+    QCOMPARE(((MTexturePixmapItem*)shaped_cw)->isDirectRendered(), true);
+    QCOMPARE(((MTexturePixmapItem*)app_cw)->isDirectRendered(), true);
+
+    // unless what shows through needs compositing
+    app->setAlpha(true);
+    QCOMPARE(cmgr->d->possiblyUnredirectTopmostWindow(), false);
+    app->setAlpha(false);
+}
+
+// app smaller than the screen with a dock filling the rest
+// (depends on the previous test)
+void ut_Compositing::testUnredirectWithDock()
+{
+    fake_LMT_window *app = new fake_LMT_window(15);
+    mapWindow(app);
+    MCompositeWindow *app_cw = cmgr->d->windows.value(15, 0);
+    fakeDamageEvent(app_cw);
+    fakeDamageEvent(app_cw);
+    while (app_cw->windowAnimator()->isActive())
+        QTest::qWait(500); // wait the animation to finish
+    app->setRealGeometry(QRect(0, 0, dwidth, dheight - 50));
+
+    fake_LMT_window *dock = new fake_LMT_window(16, dwidth, 50);
+    dock->prependType(ATOM(_NET_WM_WINDOW_TYPE_DOCK));
+    mapWindow(dock);
+    MCompositeWindow *dock_cw = cmgr->d->windows.value(16, 0);
+    fakeDamageEvent(dock_cw);
+    fakeDamageEvent(dock_cw);
+    while (dock_cw->windowAnimator()->isActive())
+        QTest::qWait(500); // wait the animation to finish
+    dock->setRealGeometry(QRect(0, dheight - 50, dwidth, 50));
+    raiseWindow(cmgr, 15);
+    raiseWindow(cmgr, 16);
+
+    QCOMPARE(cmgr->d->possiblyUnredirectTopmostWindow(), true);
+    QCOMPARE(cmgr->d->compositing, false);
+    QCOMPARE(((MTexturePixmapItem*)app_cw)->isDirectRendered(), true);
+    QCOMPARE(((MTexturePixmapItem*)dock_cw)->isDirectRendered(), true);
+
+    // a gap next to the dock needs compositing
+    dock->setRealGeometry(QRect(0, dheight - 50, dwidth / 2, 50));
+    QCOMPARE(cmgr->d->possiblyUnredirectTopmostWindow(), false);
+}
+
+// translucent window hidden by an opaque one doesn't need compositing
+// (depends on the previous test)
+void ut_Compositing::testUnredirectHiddenTranslucent()
+{
+    fake_LMT_window *rgba = new fake_LMT_window(17, dwidth / 2, 50);
+    rgba->setAlpha(true);
+    // use a dialog because those are not resized
+    rgba->prependType(ATOM(_NET_WM_WINDOW_TYPE_DIALOG));
+    mapWindow(rgba);
+    QTest::qWait(10); // run the idle handlers
+    MCompositeWindow *rgba_cw = cmgr->d->windows.value(17, 0);
+    fakeDamageEvent(rgba_cw);
+    fakeDamageEvent(rgba_cw);
+    while (rgba_cw->windowAnimator()->isActive())
+        QTest::qWait(500); // wait the animation to finish
+    rgba->setRealGeometry(QRect(0, dheight - 50, dwidth / 2, 50));
+
+    fake_LMT_window *dock = (fake_LMT_window*)cmgr->d->prop_caches.value(16, 0);
+    dock->setRealGeometry(QRect(0, dheight - 50, dwidth, 50));
+    raiseWindow(cmgr, 15);
+    raiseWindow(cmgr, 17);
+    raiseWindow(cmgr, 16);
+
+    QCOMPARE(cmgr->d->possiblyUnredirectTopmostWindow(), true);
+    QCOMPARE(cmgr->d->compositing, false);
+
+    // but it does when it's uncovered
+    dock->setRealGeometry(QRect(dwidth / 2, dheight - 50, dwidth / 2, 50));
+    QCOMPARE(cmgr->d->possiblyUnredirectTopmostWindow(), false);
+}
+
 int main(int argc, char* argv[])
 {
     // init fake but basic compositor environment
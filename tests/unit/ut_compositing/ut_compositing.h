@@ -23,6 +23,13 @@ private slots:
     void testDamageDuringTransparentMenu();
     void testDamageToObscuredRGBAWindow();
     void testDamageToObscuredSmallWindow();
+    void testUnredirectHold();
+    void testNotificationBatching();
+    void testDeepSleep();
+    void testBatchDraws();
+    void testUnredirectShapedWindow();
+    void testUnredirectWithDock();
+    void testUnredirectHiddenTranslucent();
 
 private:
     MCompositeManager *cmgr;
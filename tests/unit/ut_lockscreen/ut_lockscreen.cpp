@@ -116,6 +116,10 @@ void ut_Lockscreen::initTestCase()
     cmgr->d->prop_caches.clear();
     cmgr->d->xserver_stacking.init();
 
+    // switch to direct rendering as soon as possible
+    cmgr->config("unredirect-delay", 0);
+    cmgr->config("unredirect-max-delay", 0);
+
     // create an altered MDeviceState
     device_state = new fake_device_state();
     delete cmgr->d->device_state;
@@ -440,6 +444,84 @@ void ut_Lockscreen::testPaintingDuringScreenOff()
     QCOMPARE(cmgr->d->watch->keep_black, false);
 }
 
+void ut_Lockscreen::testInstantUnblank()
+{
+    // display off
+    device_state->fake_display_off = true;
+    cmgr->d->displayOff(true);
+
+    // map and paint lockscreen
+    fake_LMT_window *pc = (fake_LMT_window*)cmgr->d->prop_caches.value(
+                                                          lockscreen_win, 0);
+    mapWindow(pc);
+    MCompositeWindow *cw = cmgr->d->windows.value(lockscreen_win, 0);
+    QCOMPARE(cw != 0, true);
+    fakeDamageEvent(cw);
+    fakeDamageEvent(cw);
+    QCOMPARE(cmgr->d->unblankReady(), true);
+
+    // display on: shown first, the rest is done afterwards
+    unsigned fast = cmgr->d->unblanks.fast;
+    device_state->fake_display_off = false;
+    cmgr->d->displayOff(false);
+    QCOMPARE(cmgr->d->unblanks.fast, fast + 1);
+    QCOMPARE(cmgr->d->watch->keep_black, false);
+    QCOMPARE(cmgr->d->unblank_timer.isActive(), true);
+    QTest::qWait(10);
+    QCOMPARE(cmgr->d->unblank_timer.isActive(), false);
+    QCOMPARE(cmgr->d->deep_sleep, false);
+
+    unmapLockscreen();
+}
+
+void ut_Lockscreen::testLockscreenIdentifiedWhileAsleep()
+{
+    // display off
+    device_state->fake_display_off = true;
+    cmgr->d->displayOff(true);
+    QCOMPARE(cmgr->d->deep_sleep, true);
+
+    // a window which is not the lockscreen yet
+    Window w = 2;
+    fake_LMT_window *pc = new fake_LMT_window(w, false);
+    mapWindow(pc);
+    XPropertyEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = PropertyNotify;
+    e.window = w;
+    e.state = PropertyNewValue;
+    e.atom = ATOM(_MEEGOTOUCH_GLOBAL_ALPHA);
+    cmgr->d->propertyEvent(&e);
+    QCOMPARE(cmgr->d->sleep_log.properties.contains(w), true);
+
+    // it identifies itself as the lockscreen
+    pc->meego_layer = 5;
+    pc->wm_name = "Screen Lock";
+    e.atom = ATOM(WM_NAME);
+    cmgr->d->propertyEvent(&e);
+    QCOMPARE(pc->isLockScreen(), true);
+    QCOMPARE(cmgr->d->sleep_log.properties.contains(w), false);
+
+    // and is not deferred anymore
+    quint64 deferred = cmgr->d->counters.sleep_deferred;
+    e.atom = ATOM(_MEEGOTOUCH_GLOBAL_ALPHA);
+    cmgr->d->propertyEvent(&e);
+    QCOMPARE(cmgr->d->sleep_log.properties.contains(w), false);
+    QCOMPARE(cmgr->d->counters.sleep_deferred, deferred);
+
+    // display on
+    device_state->fake_display_off = false;
+    cmgr->d->displayOff(false);
+    QTest::qWait(10);
+
+    pc->wm_name = "";
+    XUnmapEvent ue;
+    memset(&ue, 0, sizeof(ue));
+    ue.window = w;
+    ue.event = QX11Info::appRootWindow();
+    cmgr->d->unmapEvent(&ue);
+}
+
 int main(int argc, char* argv[])
 {
     // init fake but basic compositor environment
@@ -19,6 +19,8 @@ private slots:
     void testScreenOnAndThenQuicklyOff();  
     void testScreenOffAndThenQuicklyOn();
     void testPaintingDuringScreenOff();
+    void testInstantUnblank();
+    void testLockscreenIdentifiedWhileAsleep();
 
 private:
     void mapWindow(MWindowPropertyCache *pc);
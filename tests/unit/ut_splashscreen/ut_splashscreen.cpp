@@ -211,6 +211,10 @@ void ut_splashscreen::initTestCase()
     cmgr->d->prepare();
     cmgr->d->xserver_stacking.init();
 
+    // switch to direct rendering as soon as possible
+    cmgr->config("unredirect-delay", 0);
+    cmgr->config("unredirect-max-delay", 0);
+
     device_state = new fake_device_state();
     cmgr->ut_replaceDeviceState(device_state);
 
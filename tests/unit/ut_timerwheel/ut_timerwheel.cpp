@@ -0,0 +1,127 @@
+#include <QtTest/QtTest>
+#include <mtimerwheel.h>
+#include "ut_timerwheel.h"
+
+void ut_TimerWheel::fired()
+{
+    order.append(static_cast<MWheelTimer*>(sender()));
+    when.append(clock.elapsed());
+}
+
+void ut_TimerWheel::deleteVictim()
+{
+    fired();
+    delete victim;
+    victim = 0;
+}
+
+void ut_TimerWheel::testSingleShot()
+{
+    MWheelTimer t;
+    QSignalSpy spy(&t, SIGNAL(timeout()));
+    int n = MTimerWheel::instance()->count();
+
+    t.setSingleShot(true);
+    t.start(100);
+    QVERIFY(t.isActive());
+    QCOMPARE(MTimerWheel::instance()->count(), n + 1);
+    QTest::qWait(50);
+    QCOMPARE(spy.count(), 0);
+    QTest::qWait(150);
+    QCOMPARE(spy.count(), 1);
+    QVERIFY(!t.isActive());
+    QCOMPARE(MTimerWheel::instance()->count(), n);
+}
+
+void ut_TimerWheel::testRepeating()
+{
+    MWheelTimer t;
+    QSignalSpy spy(&t, SIGNAL(timeout()));
+
+    t.start(50);
+    QTest::qWait(520);
+    QVERIFY(t.isActive());
+    QVERIFY(spy.count() >= 5 && spy.count() <= 10);
+    t.stop();
+    QVERIFY(!t.isActive());
+}
+
+// Restarting an active timer postpones it.
+void ut_TimerWheel::testRestart()
+{
+    MWheelTimer t;
+    QSignalSpy spy(&t, SIGNAL(timeout()));
+
+    t.setSingleShot(true);
+    t.start(200);
+    QTest::qWait(120);
+    t.start();
+    QTest::qWait(120);
+    QCOMPARE(spy.count(), 0);
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 1);
+}
+
+void ut_TimerWheel::testStop()
+{
+    MWheelTimer t;
+    QSignalSpy spy(&t, SIGNAL(timeout()));
+
+    t.setSingleShot(true);
+    t.start(50);
+    t.stop();
+    t.stop();
+    QVERIFY(!t.isActive());
+    QTest::qWait(150);
+    QCOMPARE(spy.count(), 0);
+}
+
+// Timers in different levels of the wheel fire in order and not early.
+void ut_TimerWheel::testOrder()
+{
+    static const int intervals[] = { 3000, 10, 2100, 0, 500, 2050 };
+    static const int n = sizeof(intervals) / sizeof(intervals[0]);
+    MWheelTimer t[n];
+
+    order.clear();
+    when.clear();
+    clock.start();
+    for (int i = 0; i < n; ++i) {
+        t[i].setSingleShot(true);
+        t[i].setInterval(intervals[i]);
+        connect(&t[i], SIGNAL(timeout()), SLOT(fired()));
+        t[i].start();
+    }
+    QTest::qWait(3300);
+
+    QCOMPARE(order.size(), n);
+    for (int i = 1; i < n; ++i)
+        QVERIFY(order[i]->interval() >= order[i-1]->interval());
+    for (int i = 0; i < n; ++i)
+        QVERIFY(when[i] >= order[i]->interval());
+}
+
+// A timer can delete another one which is due at the same time.
+void ut_TimerWheel::testDeleteFromTimeout()
+{
+    MWheelTimer killer;
+    victim = new MWheelTimer;
+    int n = MTimerWheel::instance()->count();
+
+    order.clear();
+    when.clear();
+    killer.setSingleShot(true);
+    victim->setSingleShot(true);
+    connect(&killer, SIGNAL(timeout()), SLOT(deleteVictim()));
+    connect(victim, SIGNAL(timeout()), SLOT(fired()));
+    killer.start(50);
+    victim->start(50);
+    QTest::qWait(150);
+
+    QCOMPARE(order.size(), 1);
+    QCOMPARE(order[0], &killer);
+    QVERIFY(!victim);
+    QCOMPARE(MTimerWheel::instance()->count(), n);
+}
+
+QTEST_MAIN(ut_TimerWheel)
@@ -0,0 +1,32 @@
+#ifndef UT_TIMERWHEEL_H
+#define UT_TIMERWHEEL_H
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QList>
+
+class MWheelTimer;
+
+class ut_TimerWheel : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testSingleShot();
+    void testRepeating();
+    void testRestart();
+    void testStop();
+    void testOrder();
+    void testDeleteFromTimeout();
+
+    // Called by the timers.
+    void fired();
+    void deleteVictim();
+
+private:
+    QElapsedTimer clock;
+    QList<MWheelTimer*> order;
+    QList<qint64> when;
+    MWheelTimer *victim;
+};
+
+#endif
@@ -0,0 +1,19 @@
+include(../../../meegotouch_config.pri)
+TEMPLATE = app
+TARGET = ut_timerwheel
+target.path = /usr/lib/mcompositor-unit-tests/
+INSTALLS += target
+DEPENDPATH += /usr/include/meegotouch/mcompositor
+INCLUDEPATH += ../../../src
+
+DEFINES += TESTS
+
+LIBS += ../../../decorators/libdecorator/libdecorator.so \
+        ../../../src/libmcompositor.so -lX11
+
+# Input
+HEADERS += ut_timerwheel.h
+SOURCES += ut_timerwheel.cpp
+
+QT += testlib core gui opengl dbus
+CONFIG += debug